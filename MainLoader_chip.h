@@ -1,89 +1,111 @@
 unsigned char MainLoader_chip_bin[] = {
-  0x01, 0x02, 0xce, 0xf7, 0x24, 0x00, 0x90, 0xad, 0x00, 0x00, 0x8c, 0xfc,
-  0x3e, 0x00, 0x00, 0xff, 0x00, 0xee, 0x07, 0xf6, 0x17, 0xee, 0x60, 0xfd,
-  0x17, 0xee, 0x60, 0xfd, 0x17, 0xee, 0x60, 0xfd, 0x17, 0xee, 0x60, 0xfd,
-  0xfb, 0xef, 0x6f, 0xfb, 0x00, 0x00, 0x7c, 0xfc, 0x40, 0x7e, 0x64, 0xfd,
-  0x40, 0x7c, 0x64, 0xfd, 0x64, 0x01, 0xb0, 0xfd, 0x79, 0xec, 0x03, 0xf6,
-  0x0d, 0xec, 0x67, 0xf0, 0x07, 0xec, 0x47, 0xf5, 0x00, 0x00, 0x80, 0xff,
-  0x3e, 0xf8, 0x0c, 0xfc, 0x3e, 0xec, 0x17, 0xfc, 0x41, 0x7c, 0x64, 0xfd,
-  0x00, 0x00, 0x80, 0xff, 0x3f, 0x7c, 0x0c, 0xfc, 0x3f, 0xec, 0x17, 0xfc,
-  0x41, 0x7e, 0x64, 0xfd, 0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d,
-  0x3f, 0x0a, 0x8e, 0xfa, 0x18, 0x0a, 0x46, 0xf0, 0x80, 0x0a, 0x0e, 0xf2,
-  0xb0, 0xff, 0x9f, 0x5d, 0x00, 0x10, 0x06, 0xf6, 0x9c, 0x00, 0xb0, 0xfd,
-  0x00, 0x10, 0x06, 0xf6, 0xe4, 0x00, 0xb0, 0xfd, 0x06, 0x05, 0x02, 0xf6,
-  0xff, 0xff, 0x7f, 0xff, 0xff, 0xf1, 0x0c, 0xf2, 0x02, 0xf1, 0x00, 0xa6,
-  0xd0, 0x00, 0xb0, 0xfd, 0x06, 0x07, 0x02, 0xf6, 0x02, 0x01, 0x88, 0xfc,
-  0x00, 0x00, 0x00, 0x00, 0xb0, 0x00, 0xb0, 0xfd, 0x15, 0x0a, 0x62, 0xfd,
-  0x05, 0x11, 0x02, 0xf1, 0xfc, 0x07, 0x6e, 0xfb, 0x00, 0x00, 0x7c, 0xfc,
-  0x5c, 0x00, 0xb0, 0xfd, 0x98, 0x00, 0xb0, 0xfd, 0x2b, 0x0a, 0x0e, 0xf2,
-  0xb4, 0xff, 0x9f, 0xad, 0x09, 0x3d, 0x80, 0xff, 0x1f, 0x00, 0x64, 0xfd,
-  0x40, 0x7c, 0x64, 0xfd, 0x40, 0x7e, 0x64, 0xfd, 0x3e, 0x00, 0x0c, 0xfc,
-  0x3f, 0x00, 0x0c, 0xfc, 0x02, 0x02, 0xce, 0xf7, 0x24, 0x00, 0x90, 0xad,
-  0x00, 0xed, 0x0b, 0xf6, 0x1c, 0x00, 0x90, 0xad, 0x00, 0xed, 0x23, 0xf5,
-  0x00, 0xec, 0x63, 0xfd, 0xe8, 0x01, 0x80, 0xff, 0x1f, 0x20, 0x65, 0xfd,
-  0x03, 0x00, 0xce, 0xf7, 0x03, 0x00, 0x46, 0xa5, 0x00, 0x00, 0x62, 0xfd,
-  0x12, 0x13, 0x80, 0xff, 0x1f, 0x40, 0x67, 0xfd, 0x78, 0x00, 0xe8, 0xfc,
-  0x08, 0x0f, 0x02, 0xf6, 0x04, 0x0e, 0x46, 0xf0, 0x0f, 0x0e, 0x06, 0xf5,
-  0x40, 0x0e, 0x06, 0xf1, 0x18, 0x00, 0xb0, 0xfd, 0x08, 0x0f, 0x02, 0xf6,
-  0x0f, 0x0e, 0x06, 0xf5, 0x40, 0x0e, 0x06, 0xf1, 0x08, 0x00, 0xb0, 0xfd,
-  0x20, 0x0e, 0x06, 0xf6, 0x00, 0x00, 0x90, 0xfd, 0x3e, 0x0e, 0x26, 0xfc,
-  0x1f, 0x28, 0x64, 0xfd, 0x40, 0x7c, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d,
-  0x2d, 0x00, 0x64, 0xfd, 0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d,
-  0x3f, 0x0a, 0x8e, 0xfa, 0x18, 0x0a, 0x46, 0x00, 0xec, 0xff, 0xbf, 0xfd,
-  0x05, 0x0d, 0x02, 0xf6, 0xe4, 0xff, 0xbf, 0xfd, 0x08, 0x0a, 0x66, 0xf0,
-  0x05, 0x0d, 0x42, 0xf5, 0xd8, 0xff, 0xbf, 0xfd, 0x10, 0x0a, 0x66, 0xf0,
-  0x05, 0x0d, 0x42, 0xf5, 0xcc, 0xff, 0xbf, 0xfd, 0x18, 0x0a, 0x66, 0xf0,
-  0x05, 0x0d, 0x42, 0x05, 0x40, 0x7e, 0x64, 0xfd, 0x01, 0x00, 0x80, 0xff,
-  0x1f, 0xd0, 0x67, 0xfd, 0x00, 0x00, 0x40, 0xff, 0x00, 0x12, 0x06, 0xf6,
-  0x01, 0x14, 0x06, 0xf6, 0x01, 0x14, 0xd6, 0xf7, 0x02, 0x14, 0xce, 0xf7,
-  0x00, 0x12, 0xf6, 0xfb, 0x24, 0x30, 0x60, 0xfd, 0x1a, 0x16, 0x62, 0xfd,
-  0x09, 0x13, 0xf2, 0xfb, 0x24, 0x30, 0x60, 0xfd, 0x1a, 0xf2, 0x60, 0xfd,
-  0x0b, 0xf3, 0x80, 0xf1, 0x2d, 0x00, 0x64, 0xfd, 0x00, 0x00, 0x00, 0x00,
-  0xff, 0xff, 0xff, 0xff, 0x9f, 0x86, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00
+  0x01, 0x14, 0x66, 0xf6, 0x40, 0x7e, 0x64, 0xfd, 0x40, 0x7c, 0x64, 0xfd,
+  0xd8, 0x03, 0xb0, 0xfd, 0x0d, 0xed, 0x03, 0xf6, 0x0d, 0xec, 0x67, 0xf0,
+  0x07, 0xec, 0x47, 0xf5, 0x00, 0x00, 0x80, 0xff, 0x3e, 0xf8, 0x0c, 0xfc,
+  0x3e, 0xec, 0x17, 0xfc, 0x41, 0x7c, 0x64, 0xfd, 0x00, 0x00, 0x80, 0xff,
+  0x3f, 0x7c, 0x0c, 0xfc, 0x3f, 0xec, 0x17, 0xfc, 0x41, 0x7e, 0x64, 0xfd,
+  0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d, 0x3f, 0x2c, 0x8e, 0xfa,
+  0x18, 0x2c, 0x46, 0xf0, 0x80, 0x2c, 0x0e, 0xf2, 0xac, 0xff, 0x9f, 0x5d,
+  0x00, 0x32, 0x06, 0xf6, 0xd8, 0x02, 0xb0, 0xfd, 0x00, 0x32, 0x06, 0xf6,
+  0x38, 0x03, 0xb0, 0xfd, 0x17, 0x25, 0x02, 0xf6, 0x00, 0x00, 0xc0, 0xff,
+  0x12, 0x01, 0x88, 0xfc, 0x12, 0x29, 0x02, 0xf6, 0x18, 0x28, 0x46, 0xf0,
+  0x17, 0x24, 0x46, 0xf7, 0x1c, 0x03, 0xb0, 0xfd, 0x17, 0x27, 0x02, 0xf6,
+  0x27, 0x28, 0xae, 0xfb, 0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d,
+  0x3f, 0x2c, 0x8e, 0xfa, 0x18, 0x2c, 0x46, 0xf0, 0x15, 0x2c, 0x62, 0xfd,
+  0x16, 0x33, 0x02, 0xf1, 0xf9, 0x27, 0x6e, 0xfb, 0x00, 0x00, 0x7c, 0xfc,
+  0xff, 0xff, 0x7f, 0xff, 0xff, 0x15, 0x0e, 0xf2, 0x12, 0x15, 0x02, 0xa6,
+  0x7c, 0x02, 0xb0, 0xfd, 0xd0, 0x02, 0xb0, 0xfd, 0x2b, 0x2c, 0x0e, 0xf2,
+  0x98, 0xff, 0x9f, 0xad, 0x2d, 0x2c, 0x0e, 0xf2, 0xec, 0xff, 0x9f, 0x5d,
+  0x09, 0x3d, 0x80, 0xff, 0x1f, 0x00, 0x64, 0xfd, 0x00, 0x18, 0x56, 0xf2,
+  0x03, 0x18, 0x62, 0x3d, 0x40, 0x7c, 0x64, 0xfd, 0x40, 0x7e, 0x64, 0xfd,
+  0x3e, 0x00, 0x0c, 0xfc, 0x3f, 0x00, 0x0c, 0xfc, 0x02, 0x22, 0xce, 0xf7,
+  0x24, 0x00, 0x90, 0xad, 0x10, 0xed, 0x0b, 0xf6, 0x1c, 0x00, 0x90, 0xad,
+  0x10, 0xed, 0x23, 0xf5, 0x00, 0xec, 0x63, 0xfd, 0xe8, 0x01, 0x80, 0xff,
+  0x1f, 0x20, 0x65, 0xfd, 0x03, 0x20, 0xce, 0xf7, 0x03, 0x20, 0x46, 0xa5,
+  0x00, 0x20, 0x62, 0xfd, 0x12, 0x13, 0x80, 0xff, 0x1f, 0x40, 0x67, 0xfd,
+  0x0a, 0x01, 0xe8, 0xfc, 0x0a, 0x28, 0x26, 0xf3, 0x30, 0x28, 0x62, 0xfd,
+  0x84, 0xff, 0x9f, 0xfd, 0x24, 0x00, 0x90, 0xfd, 0x64, 0x00, 0x90, 0xfd,
+  0x18, 0x01, 0x90, 0xfd, 0x20, 0x01, 0x90, 0xfd, 0xbc, 0x00, 0x90, 0xfd,
+  0x60, 0x01, 0x90, 0xfd, 0xb4, 0xfe, 0x9f, 0xfd, 0xa8, 0x01, 0x90, 0xfd,
+  0xbc, 0x01, 0x90, 0xfd, 0x5c, 0xff, 0x9f, 0xfd, 0x30, 0x02, 0xb0, 0xfd,
+  0x13, 0x31, 0x02, 0xf6, 0xff, 0x30, 0x06, 0xf5, 0x16, 0x31, 0x02, 0xfa,
+  0x18, 0x33, 0x02, 0xf1, 0x01, 0x2d, 0x06, 0xfa, 0x16, 0x31, 0x02, 0xf6,
+  0x10, 0x30, 0x66, 0xf0, 0x18, 0x2d, 0x42, 0xf5, 0x13, 0x2b, 0x02, 0xf6,
+  0x02, 0x2a, 0x4e, 0xf0, 0x15, 0x03, 0xd8, 0x5c, 0x17, 0x2c, 0x62, 0x5d,
+  0x03, 0x26, 0x0e, 0xf5, 0x13, 0x03, 0xd8, 0x5c, 0x15, 0x2c, 0x62, 0x5d,
+  0x08, 0xff, 0x9f, 0xfd, 0xec, 0x01, 0xb0, 0xfd, 0x16, 0x2b, 0x02, 0xf6,
+  0x80, 0x2a, 0xce, 0xf7, 0x2c, 0x00, 0x90, 0x5d, 0x01, 0x2a, 0x06, 0xf1,
+  0x15, 0x27, 0x82, 0xf1, 0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d,
+  0x3f, 0x2c, 0x8e, 0xfa, 0x18, 0x2c, 0x46, 0xf0, 0x15, 0x2c, 0x62, 0xfd,
+  0x16, 0x33, 0x02, 0xf1, 0xf9, 0x2b, 0x6e, 0xfb, 0xf2, 0x27, 0xae, 0xfb,
+  0xcc, 0xfe, 0x9f, 0xfd, 0x7d, 0x2a, 0x86, 0xf1, 0x15, 0x27, 0x82, 0xf1,
+  0xa8, 0x01, 0xb0, 0xfd, 0x15, 0x31, 0x02, 0xf6, 0x16, 0x31, 0x02, 0xfa,
+  0x18, 0x33, 0x02, 0xf1, 0x15, 0x03, 0xd8, 0xfc, 0x15, 0x2c, 0x62, 0xfd,
+  0xe8, 0x27, 0xae, 0xfb, 0xa4, 0xfe, 0x9f, 0xfd, 0x02, 0x00, 0x00, 0xff,
+  0x00, 0x2a, 0x06, 0xf6, 0x13, 0x2b, 0x22, 0xf3, 0x15, 0x27, 0x82, 0xf1,
+  0x01, 0x34, 0x66, 0xf6, 0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d,
+  0x3f, 0x2c, 0x8e, 0xfa, 0x28, 0x2c, 0x62, 0xfd, 0x0b, 0x35, 0xda, 0xf9,
+  0x0b, 0x35, 0xda, 0xf9, 0x18, 0x2c, 0x46, 0xf0, 0x15, 0x2c, 0x62, 0xfd,
+  0xf7, 0x2b, 0x6e, 0xfb, 0x1a, 0x35, 0x22, 0xf6, 0x5c, 0x01, 0xb0, 0xfd,
+  0x1a, 0x2f, 0x0a, 0xf2, 0x3e, 0x5c, 0x2c, 0xac, 0x3e, 0x42, 0x2c, 0x5c,
+  0xec, 0x27, 0xae, 0xfb, 0x50, 0xfe, 0x9f, 0xfd, 0x0d, 0x2f, 0x02, 0xf6,
+  0x04, 0x01, 0xb0, 0xfd, 0x54, 0xfe, 0x9f, 0xfd, 0x94, 0x27, 0xa6, 0xfb,
+  0x12, 0x01, 0x78, 0xfc, 0x02, 0x00, 0x00, 0xff, 0x00, 0x2a, 0x06, 0xf6,
+  0x13, 0x2b, 0x22, 0xf3, 0x15, 0x27, 0x82, 0xf1, 0x02, 0x2a, 0x46, 0xf0,
+  0x01, 0x2e, 0x66, 0xf6, 0x12, 0x30, 0x62, 0xfd, 0x69, 0x30, 0x62, 0xfd,
+  0x28, 0x30, 0x62, 0xfd, 0x08, 0x02, 0xdc, 0xfc, 0x0b, 0x2f, 0xda, 0xf9,
+  0xfa, 0x2b, 0x6e, 0xfb, 0x17, 0x2f, 0x22, 0xf6, 0xc0, 0x00, 0xb0, 0xfd,
+  0xf1, 0x27, 0xae, 0xfb, 0x0c, 0xfe, 0x9f, 0xfd, 0x82, 0x27, 0xa6, 0xfb,
+  0x12, 0x01, 0x78, 0xfc, 0x02, 0x00, 0x00, 0xff, 0x00, 0x2a, 0x06, 0xf6,
+  0x13, 0x2b, 0x22, 0xf3, 0x15, 0x27, 0x82, 0xf1, 0x01, 0x34, 0x66, 0xf6,
+  0x10, 0x30, 0x62, 0xfd, 0x18, 0x2f, 0x02, 0xf6, 0x69, 0x2e, 0x62, 0xfd,
+  0x28, 0x2e, 0x62, 0xfd, 0x0b, 0x35, 0xda, 0xf9, 0x0b, 0x35, 0xda, 0xf9,
+  0x98, 0x00, 0xb0, 0xfd, 0xf8, 0x2b, 0x6e, 0xfb, 0x1a, 0x35, 0x22, 0xf6,
+  0x1a, 0x2f, 0x02, 0xf6, 0x70, 0x00, 0xb0, 0xfd, 0xef, 0x27, 0xae, 0xfb,
+  0xbc, 0xfd, 0x9f, 0xfd, 0x10, 0x18, 0x06, 0xf6, 0x28, 0x26, 0x62, 0xfd,
+  0x12, 0x19, 0xf2, 0xfc, 0x01, 0x18, 0x66, 0xc6, 0x0c, 0x33, 0x02, 0xf6,
+  0xa4, 0xfd, 0x9f, 0xfd, 0x12, 0x2f, 0x12, 0xfb, 0xf8, 0xff, 0x9f, 0xcd,
+  0x01, 0x14, 0x66, 0xf6, 0x03, 0x26, 0xa6, 0xfb, 0x00, 0x18, 0x56, 0xf2,
+  0x03, 0x18, 0x62, 0x3d, 0x01, 0x18, 0x66, 0xf6, 0x30, 0x00, 0xb0, 0xfd,
+  0x80, 0xfd, 0x9f, 0xfd, 0x19, 0x31, 0x02, 0xf6, 0x04, 0x30, 0x46, 0xf0,
+  0x0f, 0x30, 0x06, 0xf5, 0x40, 0x30, 0x06, 0xf1, 0x30, 0x00, 0xb0, 0xfd,
+  0x19, 0x31, 0x02, 0xf6, 0x0f, 0x30, 0x06, 0xf5, 0x40, 0x30, 0x06, 0xf1,
+  0x20, 0x00, 0xb0, 0xfd, 0x20, 0x30, 0x06, 0xf6, 0x18, 0x00, 0x90, 0xfd,
+  0x04, 0xee, 0x07, 0xf6, 0x17, 0x31, 0x02, 0xf6, 0x0c, 0x00, 0xb0, 0xfd,
+  0x08, 0x2e, 0x46, 0xf0, 0xfc, 0xef, 0x6f, 0xfb, 0x2d, 0x00, 0x64, 0xfd,
+  0x3e, 0x30, 0x26, 0xfc, 0x1f, 0x28, 0x64, 0xfd, 0x40, 0x7c, 0x74, 0xfd,
+  0xf8, 0xff, 0x9f, 0x3d, 0x2d, 0x00, 0x64, 0xfd, 0x40, 0x7e, 0x74, 0xfd,
+  0xf8, 0xff, 0x9f, 0x3d, 0x3f, 0x2c, 0x8e, 0xfa, 0x18, 0x2c, 0x46, 0x00,
+  0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d, 0x3f, 0x2e, 0x8e, 0xfa,
+  0x18, 0x2e, 0x46, 0xf0, 0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d,
+  0x3f, 0x2c, 0x8e, 0xfa, 0x18, 0x2c, 0x46, 0xf0, 0x16, 0x2f, 0xca, 0xf8,
+  0x40, 0x7e, 0x74, 0xfd, 0xf8, 0xff, 0x9f, 0x3d, 0x3f, 0x2c, 0x8e, 0xfa,
+  0x18, 0x2c, 0x46, 0xf0, 0x16, 0x2f, 0xd2, 0xf8, 0x40, 0x7e, 0x74, 0xfd,
+  0xf8, 0xff, 0x9f, 0x3d, 0x3f, 0x2c, 0x8e, 0xfa, 0x18, 0x2c, 0x46, 0xf0,
+  0x16, 0x2f, 0xda, 0x08, 0x40, 0x7e, 0x64, 0xfd, 0x01, 0x00, 0x80, 0xff,
+  0x1f, 0xd0, 0x67, 0xfd, 0x00, 0x00, 0x40, 0xff, 0x00, 0x36, 0x06, 0xf6,
+  0x01, 0x38, 0x06, 0xf6, 0x01, 0x38, 0xd6, 0xf7, 0x02, 0x38, 0xce, 0xf7,
+  0x00, 0x36, 0xf6, 0xfb, 0x24, 0x30, 0x60, 0xfd, 0x1a, 0x3a, 0x62, 0xfd,
+  0x1b, 0x37, 0xf2, 0xfb, 0x24, 0x30, 0x60, 0xfd, 0x1a, 0x1a, 0x62, 0xfd,
+  0x1d, 0x1b, 0x82, 0xf1, 0x2d, 0x00, 0x64, 0xfd, 0xff, 0xff, 0xff, 0xff,
+  0x20, 0x83, 0xb8, 0xed, 0xff, 0xff, 0xff, 0xff, 0x9f, 0x86, 0x01, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
-unsigned int MainLoader_chip_bin_len = 1024;
+unsigned int MainLoader_chip_bin_len = 1088;
+/* Prop_Txt command for the first 1086 bytes of MainLoader_chip.bin */
+const char MainLoader_chip_bin_txt[] =
+  "> Prop_Txt 0 0 0 0 "
+  "ARRm9kB+ZP1AfGT92AOw/Q3tA/YN7GfwB+xH9QAAgP8++Az8PuwX/EF8ZP0AAID/P3wM/D/sF/xBfmT9QH50/fj/nz0/LI76GCxG8IAsDvKs/59dADIG9tgCsP0AMgb2 > "
+  "OAOw/RclAvYAAMD/EgGI/BIpAvYYKEbwFyRG9xwDsP0XJwL2Jyiu+0B+dP34/589PyyO+hgsRvAVLGL9FjMC8fknbvsAAHz8//9///8VDvISFQKmfAKw/dACsP0rLA7y > "
+  "mP+frS0sDvLs/59dCT2A/x8AZP0AGFbyAxhiPUB8ZP1AfmT9PgAM/D8ADPwCIs73JACQrRDtC/YcAJCtEO0j9QDsY/3oAYD/HyBl/QMgzvcDIEalACBi/RITgP8fQGf9 > "
+  "CgHo/AooJvMwKGL9hP+f/SQAkP1kAJD9GAGQ/SABkP28AJD9YAGQ/bT+n/2oAZD9vAGQ/Vz/n/0wArD9EzEC9v8wBvUWMQL6GDMC8QEtBvoWMQL2EDBm8BgtQvUTKwL2 > "
+  "AipO8BUD2FwXLGJdAyYO9RMD2FwVLGJdCP+f/ewBsP0WKwL2gCrO9ywAkF0BKgbxFSeC8UB+dP34/589PyyO+hgsRvAVLGL9FjMC8fkrbvvyJ677zP6f/X0qhvEVJ4Lx > "
+  "qAGw/RUxAvYWMQL6GDMC8RUD2PwVLGL96Ceu+6T+n/0CAAD/ACoG9hMrIvMVJ4LxATRm9kB+dP34/589PyyO+igsYv0LNdr5CzXa+RgsRvAVLGL99ytu+xo1IvZcAbD9 > "
+  "Gi8K8j5cLKw+Qixc7Ceu+1D+n/0NLwL2BAGw/VT+n/2UJ6b7EgF4/AIAAP8AKgb2Eysi8xUngvECKkbwAS5m9hIwYv1pMGL9KDBi/QgC3PwLL9r5+itu+xcvIvbAALD9 > "
+  "8Seu+wz+n/2CJ6b7EgF4/AIAAP8AKgb2Eysi8xUngvEBNGb2EDBi/RgvAvZpLmL9KC5i/Qs12vkLNdr5mACw/fgrbvsaNSL2Gi8C9nAAsP3vJ677vP2f/RAYBvYoJmL9 > "
+  "Ehny/AEYZsYMMwL2pP2f/RIvEvv4/5/NARRm9gMmpvsAGFbyAxhiPQEYZvYwALD9gP2f/RkxAvYEMEbwDzAG9UAwBvEwALD9GTEC9g8wBvVAMAbxIACw/SAwBvYYAJD9 > "
+  "BO4H9hcxAvYMALD9CC5G8Pzvb/stAGT9PjAm/B8oZP1AfHT9+P+fPS0AZP1AfnT9+P+fPT8sjvoYLEYAQH50/fj/nz0/Lo76GC5G8EB+dP34/589PyyO+hgsRvAWL8r4 > "
+  "QH50/fj/nz0/LI76GCxG8BYv0vhAfnT9+P+fPT8sjvoYLEbwFi/aCEB+ZP0BAID/H9Bn/QAAQP8ANgb2ATgG9gE41vcCOM73ADb2+yQwYP0aOmL9Gzfy+yQwYP0aGmL9 > "
+  "HRuC8S0AZP3/////IIO47f////+fhgEAAAAAAAAA > "
+  ;
+unsigned int MainLoader_chip_bin_txt_len = 1086;
@@ -44,3 +44,14 @@ unsigned char MainLoader_fpga_bin[] = {
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 unsigned int MainLoader_fpga_bin_len = 512;
+/* Prop_Txt command for the first 510 bytes of MainLoader_fpga.bin */
+const char MainLoader_fpga_bin_txt[] =
+  "> Prop_Txt 0 0 0 0 "
+  "AABh/YQAiPwgfmX9JAhg/SQoYP0fAmH9CAbc/EB+dP0BCoXwHwRh/RgKRfAVCmH99gdt+wAAfPyEAOj8AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA > "
+  "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA > "
+  "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA > "
+  "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA > "
+  "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA > "
+  "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA > "
+  ;
+unsigned int MainLoader_fpga_bin_txt_len = 510;
@@ -0,0 +1,59 @@
+/*
+ * crc32.c - CRC-32 as computed by the P2 loaders
+ *
+ * The P2's CRCNIB instruction runs the usual bit reversed CRC-32 over
+ * the bits of Q from the top down. MainLoader_chip uses it on whole
+ * longs, reversing them first, which gives the standard CRC-32 of the
+ * bytes; when it checks data as it arrives there is only time to feed
+ * in each byte as the serial smart pin delivers it, top bit first, so
+ * we need that variant too.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include "crc32.h"
+
+static uint32_t crc_table[256];
+static uint8_t bit_reverse[256];
+
+static void make_crc_table(void)
+{
+    uint32_t c;
+    int n, k;
+
+    for (n = 0; n < 256; n++) {
+        c = n;
+        for (k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+        c = 0;
+        for (k = 0; k < 8; k++) {
+            if (n & (1 << k)) c |= 0x80 >> k;
+        }
+        bit_reverse[n] = c;
+    }
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, int len)
+{
+    if (!crc_table[1]) {
+        make_crc_table();
+    }
+    crc = ~crc;
+    while (len-- > 0) {
+        crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t crc32_msb_update(uint32_t crc, const uint8_t *data, int len)
+{
+    if (!crc_table[1]) {
+        make_crc_table();
+    }
+    crc = ~crc;
+    while (len-- > 0) {
+        crc = crc_table[(crc ^ bit_reverse[*data++]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,23 @@
+/*
+ * crc32.h - CRC-32 as computed by the P2 loaders
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stdint.h>
+
+/*
+ * CRC-32 (as used by zlib) of len bytes, continuing from crc;
+ * start with a crc of 0
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, int len);
+
+/*
+ * the same CRC, but with the bits of each byte taken from the top
+ * down; this is what MainLoader_chip can compute as the bytes arrive
+ */
+uint32_t crc32_msb_update(uint32_t crc, const uint8_t *data, int len);
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * delta.c - find the parts of an image that differ from HUB memory
+ *
+ * When a board is reloaded with a program that has only changed a
+ * little, most of the new image is already sitting in HUB memory. The
+ * loader can report a CRC-32 of each block of HUB, which is much less
+ * to send back than the blocks themselves; the host then only has to
+ * send the blocks whose CRC does not match its own.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include "delta.h"
+#include "crc32.h"
+
+void delta_hash(const uint8_t *mem, int len, uint32_t *hashes)
+{
+    int n;
+
+    while (len > 0) {
+        n = len < DELTA_BLOCK ? len : DELTA_BLOCK;
+        *hashes++ = crc32_update(0, mem, n);
+        mem += n;
+        len -= n;
+    }
+}
+
+int delta_diff(const uint8_t *image, int len, const uint32_t *hashes, DeltaRun *runs)
+{
+    int nruns = 0;
+    int offset, n;
+
+    for (offset = 0; offset < len; offset += DELTA_BLOCK) {
+        n = len - offset < DELTA_BLOCK ? len - offset : DELTA_BLOCK;
+        if (crc32_update(0, image + offset, n) == *hashes++) {
+            continue;
+        }
+        if (nruns > 0 && runs[nruns-1].offset + runs[nruns-1].len == offset) {
+            runs[nruns-1].len += n;
+        } else {
+            runs[nruns].offset = offset;
+            runs[nruns].len = n;
+            nruns++;
+        }
+    }
+    return nruns;
+}
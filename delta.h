@@ -0,0 +1,39 @@
+/*
+ * delta.h - find the parts of an image that differ from HUB memory
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stdint.h>
+
+/* bytes covered by each block hash; must match MainLoader_chip.spin2 */
+#define DELTA_BLOCK 1024
+
+/* a stretch of the image that has to be sent */
+typedef struct delta_run {
+    int offset;
+    int len;
+} DeltaRun;
+
+/* number of block hashes that cover len bytes */
+#define DELTA_BLOCKS(len) (((len) + DELTA_BLOCK - 1) / DELTA_BLOCK)
+
+/*
+ * hash len bytes of memory the way the loader does, one CRC-32 for each
+ * DELTA_BLOCK bytes (the last block may be shorter); mostly useful for
+ * testing against a simulated HUB
+ */
+void delta_hash(const uint8_t *mem, int len, uint32_t *hashes);
+
+/*
+ * compare len bytes of image against the block hashes of the memory it
+ * is to be loaded into, and list the stretches that have to be sent;
+ * neighbouring blocks that differ are combined
+ * returns the number of runs written to runs, which must have room for
+ * DELTA_BLOCKS(len) / 2 + 1 of them
+ */
+int delta_diff(const uint8_t *image, int len, const uint32_t *hashes, DeltaRun *runs);
+
+#endif
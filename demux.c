@@ -0,0 +1,192 @@
+/*
+ * demux.c - split the P2's output into console text, exit codes and
+ * file server requests
+ *
+ * Everything the P2 prints is console text, except for three escapes:
+ * 0xFF 0x00 followed by an exit status, 0xFF 0x01 followed by a 9P
+ * message (which starts with its own 4 byte little-endian size), and
+ * 0xFF 0x02 followed by a channel frame (see mux.h).
+ * Reads from the port break wherever they like, so this keeps track
+ * of where it is between calls. Text is handed on in runs pointing
+ * into the caller's buffer; a message is only copied when it arrives
+ * in more than one piece.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "demux.h"
+#include "mux.h"
+
+enum {
+    DEMUX_TEXT,         /* console text */
+    DEMUX_ESCAPE,       /* just saw DEMUX_ESC */
+    DEMUX_EXITCODE,     /* next byte is the exit status */
+    DEMUX_FRAME,        /* collecting a 9P message */
+    DEMUX_CHANHDR,      /* collecting a channel frame's header */
+    DEMUX_CHANDATA,     /* passing on a channel frame's data */
+    DEMUX_DONE,         /* the program has exited */
+};
+
+static const uint8_t esc_byte = DEMUX_ESC;
+
+static int frame_size(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static int frame_ok(Demux *d, unsigned size)
+{
+    return size >= DEMUX_MINFRAME && size <= (unsigned)d->maxframe;
+}
+
+int demux_init(Demux *d, int flags, int maxframe, const DemuxOps *ops, void *arg)
+{
+    memset(d, 0, sizeof(*d));
+    d->ops = ops;
+    d->arg = arg;
+    d->flags = flags;
+    d->state = DEMUX_TEXT;
+    if (flags & DEMUX_FILES) {
+        d->frame = malloc(maxframe);
+        if (!d->frame) {
+            return -1;
+        }
+        d->maxframe = maxframe;
+    }
+    return 0;
+}
+
+void demux_free(Demux *d)
+{
+    free(d->frame);
+    d->frame = NULL;
+}
+
+/* collect a channel frame's header; returns the bytes used */
+static int add_chanhdr(Demux *d, const uint8_t *buf, int len)
+{
+    int n = sizeof(d->hdr) - d->have;
+
+    if (n > len) n = len;
+    memcpy(d->hdr + d->have, buf, n);
+    d->have += n;
+    if (d->have < (int)sizeof(d->hdr)) {
+        return n;
+    }
+    d->chan = d->hdr[0];
+    d->left = d->hdr[1] | (d->hdr[2] << 8);
+    if (d->chan >= MUX_CHANNELS || d->left > MUX_MAXDATA) {
+        // not a frame after all; show what came
+        d->ops->text(d->arg, &esc_byte, 1);
+        d->ops->text(d->arg, (const uint8_t *)"\002", 1);
+        d->ops->text(d->arg, d->hdr, sizeof(d->hdr));
+        d->state = DEMUX_TEXT;
+    } else {
+        d->state = d->left ? DEMUX_CHANDATA : DEMUX_TEXT;
+    }
+    return n;
+}
+
+/* collect a message that did not arrive all at once */
+static int add_frame(Demux *d, const uint8_t *buf, int len)
+{
+    int want = d->have < 4 ? 4 : d->need;
+    int n = want - d->have;
+
+    if (n > len) n = len;
+    memcpy(d->frame + d->have, buf, n);
+    d->have += n;
+    if (d->have == 4) {
+        d->need = frame_size(d->frame);
+        if (!frame_ok(d, d->need)) {
+            // out of step with the P2; show what came rather than lose it
+            d->ops->text(d->arg, &esc_byte, 1);
+            d->ops->text(d->arg, (const uint8_t *)"\001", 1);
+            d->ops->text(d->arg, d->frame, 4);
+            d->state = DEMUX_TEXT;
+            return n;
+        }
+    }
+    if (d->have > 4 && d->have == d->need) {
+        d->state = DEMUX_TEXT;
+        d->ops->frame(d->arg, d->frame, d->need);
+    }
+    return n;
+}
+
+int demux_input(Demux *d, const uint8_t *buf, int len)
+{
+    const uint8_t *esc;
+    int i = 0;
+    int start, size;
+
+    while (i < len) {
+        switch (d->state) {
+        case DEMUX_TEXT:
+            start = i;
+            esc = NULL;
+            if (d->flags & DEMUX_EXIT) {
+                esc = memchr(buf + i, DEMUX_ESC, len - i);
+            }
+            i = esc ? esc - buf : len;
+            if (i > start) {
+                d->ops->text(d->arg, buf + start, i - start);
+            }
+            if (esc) {
+                d->state = DEMUX_ESCAPE;
+                i++;
+            }
+            break;
+        case DEMUX_ESCAPE:
+            if (buf[i] == 0) {
+                d->state = DEMUX_EXITCODE;
+            } else if (buf[i] == 1 && (d->flags & DEMUX_FILES)) {
+                d->state = DEMUX_FRAME;
+                d->have = 0;
+            } else if (buf[i] == MUX_FRAME && (d->flags & DEMUX_CHANNELS)) {
+                d->state = DEMUX_CHANHDR;
+                d->have = 0;
+            } else {
+                // not an escape after all: both bytes are text
+                d->ops->text(d->arg, &esc_byte, 1);
+                d->ops->text(d->arg, buf + i, 1);
+                d->state = DEMUX_TEXT;
+            }
+            i++;
+            break;
+        case DEMUX_EXITCODE:
+            d->state = DEMUX_DONE;
+            d->ops->exit(d->arg, buf[i++]);
+            return i;
+        case DEMUX_FRAME:
+            if (d->have == 0 && len - i >= 4) {
+                size = frame_size(buf + i);
+                if (frame_ok(d, size) && len - i >= size) {
+                    // all here; no need to copy it
+                    d->state = DEMUX_TEXT;
+                    d->ops->frame(d->arg, buf + i, size);
+                    i += size;
+                    break;
+                }
+            }
+            i += add_frame(d, buf + i, len - i);
+            break;
+        case DEMUX_CHANHDR:
+            i += add_chanhdr(d, buf + i, len - i);
+            break;
+        case DEMUX_CHANDATA:
+            size = len - i < d->left ? len - i : d->left;
+            d->left -= size;
+            if (d->left == 0) {
+                d->state = DEMUX_TEXT;
+            }
+            d->ops->chunk(d->arg, d->chan, buf + i, size);
+            i += size;
+            break;
+        default:
+            return i;
+        }
+    }
+    return i;
+}
@@ -0,0 +1,63 @@
+/*
+ * demux.h - split the P2's output into console text, exit codes and
+ * file server requests
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __DEMUX_H__
+#define __DEMUX_H__
+
+#include <stdint.h>
+
+/* starts an exit code, a file server request or a channel frame */
+#define DEMUX_ESC 0xff
+
+/* flags for demux_init() */
+#define DEMUX_EXIT  0x01    /* look for escapes at all: 0xFF 0x00 code */
+#define DEMUX_FILES 0x02    /* 0xFF 0x01 starts a 9P message */
+#define DEMUX_CHANNELS 0x04 /* 0xFF 0x02 starts a channel frame; see mux.h */
+
+/* the smallest 9P message: size[4] type[1] tag[2] */
+#define DEMUX_MINFRAME 7
+
+typedef struct demux_ops {
+    /* console text, pointing straight into the input */
+    void (*text)(void *arg, const uint8_t *data, int len);
+    /* the program exited with this status */
+    void (*exit)(void *arg, int code);
+    /* a whole 9P message, size and all */
+    void (*frame)(void *arg, const uint8_t *msg, int len);
+    /* some of a channel frame's data, pointing straight into the input */
+    void (*chunk)(void *arg, int chan, const uint8_t *data, int len);
+} DemuxOps;
+
+typedef struct demux {
+    const DemuxOps *ops;
+    void *arg;
+    int flags;
+    int state;
+    uint8_t *frame;     /* a message that arrived in pieces */
+    int maxframe;
+    int have;           /* bytes of it so far */
+    int need;           /* its size, once the first 4 bytes are in */
+    uint8_t hdr[3];     /* a channel frame's header */
+    int chan;           /* the channel frame being passed on */
+    int left;           /* and how much of it is still to come */
+} Demux;
+
+/*
+ * set up d to pass what it finds to ops; 9P messages may be up to
+ * maxframe bytes long
+ * returns 0 on success, -1 if out of memory
+ */
+int demux_init(Demux *d, int flags, int maxframe, const DemuxOps *ops, void *arg);
+void demux_free(Demux *d);
+
+/*
+ * handle the next len bytes of output, which may break anywhere
+ * returns the number of bytes used: len, unless the exit code was
+ * among them, after which nothing more is taken
+ */
+int demux_input(Demux *d, const uint8_t *buf, int len);
+
+#endif
@@ -30,8 +30,22 @@
 #include <string.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include "osint.h"
 #include "loadelf.h"
+#include "rle.h"
+#include "delta.h"
+#include "crc32.h"
+
+/*
+ * MainLoader_chip runs from RCFAST, which is 20 MHz or a little more,
+ * and needs LOADER_BYTE_CLOCKS clocks for each byte it receives in the
+ * worst case, so at a system clock of f it can take up to
+ * f * 10 / LOADER_BYTE_CLOCKS baud
+ */
+#define RCFAST_FREQ        20000000
+#define LOADER_BYTE_CLOCKS 25
+#define LOADER_MAX_BAUD    (RCFAST_FREQ / LOADER_BYTE_CLOCKS * 10)
 
 /* default FIFO size of FT231X in P2-EVAL board and PropPlugs */
 #define FIFO_SIZE   512
@@ -44,6 +58,9 @@
 #define LOAD_FPGA   1
 #define LOAD_SINGLE 2
 
+/* loadfile() result when the loader did not start on an unprobed cached port */
+#define LOADFILE_RETRY 2
+
 static int loader_baud = 2000000;
 static int clock_mode = -1;
 static int user_baud = 115200;
@@ -54,10 +71,31 @@ static int patch_mode = 0;
 static int use_checksum = 1;
 static int quiet_mode = 0;
 static int enter_rom = NO_ENTER;
+static int use_base64 = 1;
+static int list_ports = 0;
+static int use_port_cache = 1;
+static int use_compression = 0;
+static int use_delta = 0;
+static int use_framing = 0;
+static int use_pipeline = 0;
+static int use_verify = 0;
+static unsigned dump_address;
+static int dump_len;
+static char *dump_file = NULL;
+static unsigned xmem_mailbox;
+static unsigned xmem_command;
+static char *xmem_driver = NULL;
+static int loader_baud_set = 0;
+static int loader_baud_auto = 0;
+static int cached_loader_baud = 0;
+static int cache_unverified = 0;    // using the cached port without a Prop_Chk
+static int fifo_size_set = 0;
 static char *send_script = NULL;
 
 int get_loader_baud(int ubaud, int lbaud);
+int get_clock_mode(int sysfreq);
 static void RunScript(char *script);
+static void check_loader_baud(void);
 
 #if defined(__CYGWIN__) || defined(__MINGW32__) || defined(__MINGW64__)
   #define PORT_PREFIX "com"
@@ -71,6 +109,27 @@ static void RunScript(char *script);
   #include <dirent.h>
 #endif
 
+#include "portcache.h"
+
+#if !defined(__MINGW32__) && !defined(__MINGW64__)
+  #define HAVE_FORK
+  #include <errno.h>
+  #include <unistd.h>
+  #include <sys/wait.h>
+#endif
+
+#if !defined(__MINGW32__) && !defined(__MINGW64__)
+  #define HAVE_MMAP
+  #include <sys/mman.h>
+#endif
+
+#if !defined(__MINGW32__) && !defined(__MINGW64__)
+  #define HAVE_REACTOR
+  #include "reactor.h"
+#endif
+
+// most boards we will load at once with several -p options
+#define MAX_PORTS 64
 #include "MainLoader_fpga.h"
 #include "MainLoader_chip.h"
 
@@ -122,9 +181,9 @@ static void Usage(const char *msg)
 printf("\
 loadp2 - a loader for the propeller 2 - version 0.049 " __DATE__ "\n\
 usage: loadp2\n\
-         [ -p port ]               serial port\n\
+         [ -p port ]               serial port (may be repeated to load several boards)\n\
          [ -b baud ]               user baud rate (default is %d)\n\
-         [ -l baud ]               loader baud rate (default is %d)\n\
+         [ -l baud ]               loader baud rate (default is %d), max, or auto\n\
          [ -f clkfreq ]            clock frequency (default is %d)\n\
          [ -m clkmode ]            clock mode in hex (default is %02x)\n\
          [ -s address ]            starting address in hex (default is 0)\n\
@@ -135,6 +194,8 @@ usage: loadp2\n\
          [ -q ]                    quiet mode: also checks for exit sequence\n\
          [ -n ]                    no reset; skip any hardware reset\n\
          [ -9 dir ]                serve 9p remote filesystem from dir\n\
+         [ -CHANNELS ]             let the program use channels (see README)\n\
+         [ -TELEMETRY sink ]       save the program's telemetry channel to a file or tcp:host:port\n\
          [ -FIFO bytes]            modify serial FIFO size (default is %d bytes)\n\
          [ -? ]                    display a usage message and exit\n\
          [ -DTR ]                  use DTR for reset (default)\n\
@@ -147,6 +208,17 @@ usage: loadp2\n\
          [ -NOZERO ]               do not clear memory before download (default)\n\
          [ -ZERO ]                 clear memory before download\n\
          [ -SINGLE ]               set load mode for single stage\n\
+         [ -HEX ]                  use Prop_Hex instead of Prop_Txt (base64) for ROM loads\n\
+         [ -LIST ]                 list the serial ports with a P2 attached and exit\n\
+         [ -NOCACHE ]              do not use or update the cache of known P2 ports\n\
+         [ -COMPRESS ]             compress the data sent to the -CHIP loader\n\
+         [ -DELTA ]                only send the parts of the program not already in memory\n\
+         [ -FRAMED ]               send -CHIP data in CRC checked blocks, resending bad ones\n\
+         [ -PIPELINE ]             send -CHIP records without waiting for each checksum\n\
+         [ -VERIFY ]               check HUB memory against the files before starting them\n\
+         [ -DUMP addr,len,file ]   save len bytes of HUB at addr to file instead of loading (hex)\n\
+         [ -XMEM mbox,drv[,cmd] ]  start external memory driver drv with its mailbox at mbox (hex)\n\
+         [ -XLOAD addr,file ]      stream file to external memory at addr (hex) through the driver\n\
          filespec                  file to load\n\
          [ -e script ]             send a sequence of characters after starting P2\n\
 ", user_baud, loader_baud, clock_freq, clock_mode, FIFO_SIZE);
@@ -201,6 +273,143 @@ void txstring(unsigned char *bytes, int len)
     }
 }
 
+/*
+ * base64 encoding for the ROM's Prop_Txt command; this costs 4 characters
+ * for every 3 bytes, as opposed to 3 characters per byte for Prop_Hex
+ */
+static const char b64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* bytes per line of base64 output; a multiple of 3 so lines don't need padding */
+#define B64_LINE_BYTES 96
+
+/*
+ * encode len bytes into out, returns number of characters written
+ * no '=' padding is produced; the ROM simply discards any left over bits
+ */
+static int base64_encode(char *out, const uint8_t *in, int len)
+{
+    char *start = out;
+    unsigned val;
+
+    while (len >= 3) {
+        val = (in[0] << 16) | (in[1] << 8) | in[2];
+        *out++ = b64_chars[(val >> 18) & 63];
+        *out++ = b64_chars[(val >> 12) & 63];
+        *out++ = b64_chars[(val >> 6) & 63];
+        *out++ = b64_chars[val & 63];
+        in += 3;
+        len -= 3;
+    }
+    if (len > 0) {
+        val = in[0] << 16;
+        if (len > 1) val |= in[1] << 8;
+        *out++ = b64_chars[(val >> 18) & 63];
+        *out++ = b64_chars[(val >> 12) & 63];
+        if (len > 1) *out++ = b64_chars[(val >> 6) & 63];
+    }
+    return out - start;
+}
+
+/*
+ * base64 encode len bytes of data as text for a Prop_Txt command
+ * a " > " is inserted after every line to keep the ROM's autobaud in sync
+ * returns the number of characters written
+ */
+static int base64_lines(char *out, const uint8_t *data, int len)
+{
+    char *ptr = out;
+    int num;
+
+    while (len > 0) {
+        num = len < B64_LINE_BYTES ? len : B64_LINE_BYTES;
+        ptr += base64_encode(ptr, data, num);
+        data += num;
+        len -= num;
+        if (len > 0) {
+            strcpy(ptr, " > ");
+            ptr += 3;
+        }
+    }
+    return ptr - out;
+}
+
+/* worst case size of base64_lines() output */
+#define BASE64_LINES_SIZE(len) \
+    (((len) + 2) / 3 * 4 + ((len) / B64_LINE_BYTES + 1) * 3)
+
+/*
+ * send len bytes of data to the ROM loader with a single Prop_Txt command,
+ * finished by "term" ('~' to just run, '?' to verify the checksum first)
+ */
+static void txbase64(const uint8_t *data, int len, int term)
+{
+    static const char header[] = "> Prop_Txt 0 0 0 0 ";
+    char *str = malloc(sizeof(header) + BASE64_LINES_SIZE(len) + 2);
+    char *ptr;
+
+    if (!str) {
+        printf("Out of memory encoding %d bytes\n", len);
+        promptexit(1);
+    }
+    strcpy(str, header);
+    ptr = str + strlen(header);
+    ptr += base64_lines(ptr, data, len);
+    *ptr++ = ' ';
+    *ptr++ = term;
+    tx((uint8_t *)str, ptr - str);
+    free(str);
+}
+
+/*
+ * send a fast loader binary followed by its parameter longs to the ROM
+ * "txt" is the loader's Prop_Txt command pre-encoded at build time for
+ * its first txtlen bytes, so only the tail and the parameters need
+ * encoding here; the whole command goes out with a single tx()
+ */
+static void txloader(const uint8_t *loader, int len, const char *txt, int txtlen,
+                     const int *params, int nparams)
+{
+    uint8_t tail[64];
+    int taillen = len - txtlen;
+    char *str;
+    char *ptr;
+    int i;
+
+    if (!use_base64) {
+        tx((uint8_t *)"> Prop_Hex 0 0 0 0", 18);
+        txstring((uint8_t *)loader, len);
+        for (i = 0; i < nparams; i++) {
+            txval(params[i]);
+        }
+        tx((uint8_t *)"~", 1);
+        return;
+    }
+    if (taillen < 0 || taillen + 4*nparams > sizeof(tail)) {
+        printf("Internal error: bad pre-encoded loader\n");
+        promptexit(1);
+    }
+    memcpy(tail, loader + txtlen, taillen);
+    for (i = 0; i < nparams; i++) {
+        tail[taillen++] = params[i] & 0xff;
+        tail[taillen++] = (params[i] >> 8) & 0xff;
+        tail[taillen++] = (params[i] >> 16) & 0xff;
+        tail[taillen++] = (params[i] >> 24) & 0xff;
+    }
+    str = malloc(strlen(txt) + BASE64_LINES_SIZE(taillen) + 2);
+    if (!str) {
+        printf("Out of memory building loader command\n");
+        promptexit(1);
+    }
+    strcpy(str, txt);
+    ptr = str + strlen(txt);
+    ptr += base64_lines(ptr, tail, taillen);
+    *ptr++ = ' ';
+    *ptr++ = '~';
+    tx((uint8_t *)str, ptr - str);
+    free(str);
+}
+
 int compute_checksum(int *ptr, int num)
 {
     int checksum = 0;
@@ -214,11 +423,72 @@ int compute_checksum(int *ptr, int num)
 /*
  * ultimately the final image to be loaded ends up in a binary blob pointed to
  * by g_filedata, of size g_filesize. g_fileptr is used to stream the data
+ * g_regions lists the parts of the image that actually have to be loaded,
+ * each pointing at its data in the file; for an ELF file there is one for
+ * each loadable segment, and the gaps between them are left alone
+ * files are mapped into memory where we can, so that -CHIP loads are sent
+ * straight from the file's pages; an ELF file only gets a blob of its own
+ * (see flat_image) for the loaders that need the image in one piece
  */
 
-uint8_t *g_filedata;
+/* gaps smaller than this are zeroed along with the segment before them */
+#define ELF_GAP_MIN 256
+
+typedef struct load_region {
+    int offset;             /* offset of the region in the image */
+    const uint8_t *data;    /* its data, where it sits in the file */
+    int filesz;             /* bytes of data to send */
+    int memsz;              /* bytes of memory; the rest is zeroed */
+} LoadRegion;
+
+const uint8_t *g_filedata;
 int g_filesize;
 int g_fileptr;
+LoadRegion *g_regions;
+int g_nregions;
+
+static int region_cmp(const void *a, const void *b)
+{
+    return ((const LoadRegion *)a)->offset - ((const LoadRegion *)b)->offset;
+}
+
+/*
+ * get the whole of an open file into memory, mapping it if we can
+ * sets *size_p to its length; returns NULL on error
+ */
+static const uint8_t *map_file(FILE *infile, int *size_p)
+{
+    uint8_t *data;
+    long size;
+
+    fseek(infile, 0, SEEK_END);
+    size = ftell(infile);
+    fseek(infile, 0, SEEK_SET);
+    if (size < 0 || size > 0x7fffffff) {
+        printf("Could not find the size of the file\n");
+        return NULL;
+    }
+    *size_p = size;
+#ifdef HAVE_MMAP
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(infile), 0);
+        if (data != MAP_FAILED) {
+            return data;
+        }
+    }
+#endif
+    data = (uint8_t *)malloc(size ? size : 1);
+    if (!data) {
+        printf("Could not allocate %ld bytes\n", size);
+        return NULL;
+    }
+    if ((long)fread(data, 1, size, infile) != size) {
+        printf("read error\n");
+        free(data);
+        return NULL;
+    }
+    return data;
+}
 
 /*
  * read an ELF file into memory
@@ -231,7 +501,12 @@ readElfFile(FILE *infile, ElfHdr *hdr)
     int size = 0;
     unsigned int base = -1;
     unsigned int top = 0;
-    int i, r;
+    const uint8_t *file;
+    int filelen;
+    LoadRegion *regions;
+    LoadRegion *last;
+    int nregions = 0;
+    int i;
     
     c = OpenElfFile(infile, hdr);
     if (!c) {
@@ -244,7 +519,7 @@ readElfFile(FILE *infile, ElfHdr *hdr)
             printf("Error reading ELF program header %d\n", i);
             return -1;
         }
-        if (program.type != PT_LOAD) {
+        if (program.type != PT_LOAD || program.memsz == 0) {
             continue;
         }
         //printf("load %d bytes at %x\n", program.filesz, program.paddr);
@@ -259,36 +534,94 @@ readElfFile(FILE *infile, ElfHdr *hdr)
             top = program.paddr + program.memsz;
         }
     }
-    size = top - size;
+    if (top <= base) {
+        printf("ELF file has nothing to load\n");
+        return -1;
+    }
+    size = top - base;
     if (size > 0xffffff) {
         printf("image size %d bytes is too large to handle\n", size);
         return -1;
     }
-    g_filedata = (uint8_t *)calloc(1, size);
-    if (!g_filedata) {
-        printf("Could not allocate %d bytes\n", size);
+    // the segments are used where they sit in the file
+    file = map_file(infile, &filelen);
+    if (!file) {
+        return -1;
+    }
+    regions = (LoadRegion *)calloc(c->hdr.phnum, sizeof(LoadRegion));
+    if (!regions) {
+        printf("Could not allocate %d bytes\n", (int)(c->hdr.phnum * sizeof(LoadRegion)));
         return -1;
     }
-    g_filesize = size;
     for (i = 0; i < c->hdr.phnum; i++) {
         if (!LoadProgramTableEntry(c, i, &program)) {
             printf("Error reading ELF program header %d\n", i);
             return -1;
         }
-        if (program.type != PT_LOAD) {
+        if (program.type != PT_LOAD || program.memsz == 0) {
             continue;
         }
-        fseek(infile, program.offset, SEEK_SET);
-        r = fread(g_filedata + program.paddr - base, 1, program.filesz, infile);
-        if (r != program.filesz) {
+        if (program.offset > (unsigned)filelen
+            || program.filesz > (unsigned)filelen - program.offset)
+        {
             printf("read error in ELF file\n");
             return -1;
         }
+        regions[nregions].offset = program.paddr - base;
+        regions[nregions].data = file + program.offset;
+        regions[nregions].filesz = program.filesz;
+        regions[nregions].memsz = program.memsz;
+        nregions++;
+    }
+    fclose(infile);
+    FreeElfContext(c);
+    // sort the segments into address order, merging segments that meet
+    // both in memory and in the file
+    qsort(regions, nregions, sizeof(LoadRegion), region_cmp);
+    last = NULL;
+    for (i = 0; i < nregions; i++) {
+        if (last && regions[i].offset > last->offset + last->memsz
+            && regions[i].offset - (last->offset + last->memsz) < ELF_GAP_MIN)
+        {
+            last->memsz = regions[i].offset - last->offset;
+        }
+        if (last && last->filesz == last->memsz
+            && regions[i].offset == last->offset + last->memsz
+            && regions[i].data == last->data + last->filesz)
+        {
+            last->filesz += regions[i].filesz;
+            last->memsz += regions[i].memsz;
+        } else {
+            last = last ? last + 1 : regions;
+            *last = regions[i];
+        }
     }
+    g_filedata = NULL;
+    g_filesize = size;
+    g_regions = regions;
+    g_nregions = last ? last - regions + 1 : 0;
     //printf("ELF: total size = %d\n", size);
     return size;
 }
 
+/*
+ * files already in memory, so that a file named more than once (or
+ * loaded onto several boards) is only read once
+ */
+typedef struct loaded_file {
+    struct loaded_file *next;
+    char *name;
+    const uint8_t *data;
+    int size;
+    LoadRegion *regions;
+    int nregions;
+} LoadedFile;
+
+static LoadedFile *loaded_files;
+static LoadedFile *current_file;
+
+static int readFileContents(char *fname);
+
 /*
  * read a simple binary file into memory
  * sets g_filedata to point to the data, 
@@ -298,12 +631,74 @@ readElfFile(FILE *infile, ElfHdr *hdr)
 
 int 
 readBinaryFile(char *fname)
+{
+    LoadedFile *lf;
+    int size;
+
+    g_fileptr = 0;
+    for (lf = loaded_files; lf; lf = lf->next) {
+        if (!strcmp(lf->name, fname)) {
+            g_filedata = lf->data;
+            g_filesize = lf->size;
+            g_regions = lf->regions;
+            g_nregions = lf->nregions;
+            current_file = lf;
+            return g_filesize;
+        }
+    }
+    current_file = NULL;
+    size = readFileContents(fname);
+    if (size < 0) {
+        return size;
+    }
+    lf = calloc(1, sizeof(*lf));
+    if (lf && (lf->name = duplicate_string(fname)) != NULL) {
+        lf->data = g_filedata;
+        lf->size = g_filesize;
+        lf->regions = g_regions;
+        lf->nregions = g_nregions;
+        lf->next = loaded_files;
+        loaded_files = lf;
+        current_file = lf;
+    }
+    return size;
+}
+
+/*
+ * lay the current file out as one blob, gaps and all, for the loaders
+ * that send it in one piece; a binary file already is one
+ * returns NULL if there is no memory for it
+ */
+static const uint8_t *flat_image(void)
+{
+    uint8_t *image;
+    int i;
+
+    if (!g_filedata) {
+        image = (uint8_t *)calloc(1, g_filesize);
+        if (!image) {
+            printf("Could not allocate %d bytes\n", g_filesize);
+            return NULL;
+        }
+        for (i = 0; i < g_nregions; i++) {
+            memcpy(image + g_regions[i].offset, g_regions[i].data, g_regions[i].filesz);
+        }
+        g_filedata = image;
+        if (current_file) {
+            current_file->data = image;
+        }
+    }
+    return g_filedata;
+}
+
+static int
+readFileContents(char *fname)
 {
     int size;
     FILE *infile;
     ElfHdr hdr;
+    const uint8_t *data;
     
-    g_fileptr = 0;
     infile = fopen(fname, "rb");
     if (!infile)
     {
@@ -317,16 +712,22 @@ readBinaryFile(char *fname)
         //printf("not an ELF file\n");
     }
     
-    fseek(infile, 0, SEEK_END);
-    size = ftell(infile);
-    fseek(infile, 0, SEEK_SET);
-    g_filedata = (uint8_t *)malloc(size);
-    if (!g_filedata) {
-        printf("Could not allocate %d bytes\n", size);
+    data = map_file(infile, &size);
+    fclose(infile);
+    if (!data) {
         return -1;
     }
-    size = g_filesize = fread(g_filedata, 1, size, infile);
-    fclose(infile);
+    g_filedata = data;
+    g_filesize = size;
+    // the whole of a binary file is loaded
+    g_regions = (LoadRegion *)calloc(1, sizeof(LoadRegion));
+    if (!g_regions) {
+        printf("Could not allocate %d bytes\n", (int)sizeof(LoadRegion));
+        return -1;
+    }
+    g_regions->data = data;
+    g_regions->filesz = g_regions->memsz = size;
+    g_nregions = 1;
     return size;
 }
 
@@ -346,6 +747,133 @@ loadBytes(char *buffer, int size)
     return r;
 }
 
+/*
+ * milliseconds for the adapter's FIFO to empty at the loader baud rate
+ * we can't see into the USB bridge, so this is the one wait we must
+ * estimate rather than observe
+ */
+static int fifo_ms(void)
+{
+    return 1 + fifo_size*10*1000/loader_baud;
+}
+
+/*
+ * receive exactly n bytes, giving up after timeout milliseconds
+ * returns as soon as the data arrives, so the timeout is only a guard
+ * returns the number of bytes actually received
+ */
+static int rx_wait(uint8_t *buf, int n, int timeout)
+{
+    unsigned long long deadline = elapsedms() + timeout;
+    unsigned long long now;
+    int got = 0;
+    int r;
+
+    while (got < n) {
+        now = elapsedms();
+        if (now >= deadline) {
+            break;
+        }
+        r = rx_timeout(buf + got, n - got, (int)(deadline - now));
+        if (r > 0) {
+            got += r;
+        }
+    }
+    return got;
+}
+
+/*
+ * make sure everything sent so far has actually gone out on the wire
+ */
+static void wait_sent(void)
+{
+    wait_drain();
+    msleep(fifo_ms());
+}
+
+/*
+ * per-phase timing for -v
+ */
+static unsigned long long phase_start;
+
+static void phase_begin(void)
+{
+    phase_start = elapsedms();
+}
+
+static void phase_end(const char *what)
+{
+    unsigned long long now = elapsedms();
+
+    if (verbose) {
+        printf("  %-24s %6llu ms\n", what, now - phase_start);
+    }
+    phase_start = now;
+}
+
+/*
+ * wait for the ROM's reply to a '?' checksum request; "." means success
+ */
+static void check_single_response(char *fname)
+{
+    int num;
+
+    wait_drain();
+    num = rx_wait((uint8_t *)buffer, 1, fifo_ms() + 200);
+    if (num >= 0) buffer[num] = 0;
+    else buffer[0] = 0;
+    if (strcmp(buffer, "."))
+    {
+        printf("%s failed to load\n", fname);
+        printf("Error response was \"%s\"\n", buffer);
+        promptexit(1);
+    }
+    if (verbose)
+        printf("Checksum validated\n");
+}
+
+/*
+ * single stage load using the ROM's Prop_Txt (base64) command
+ * the image (padded to a whole number of longs) and its checksum long
+ * form one continuous base64 stream
+ */
+static int loadfilesingle_base64(char *fname, int size)
+{
+    int padsize = (size + 3) & ~3;
+    uint8_t *image = calloc(1, padsize + 4);
+    int checksum;
+
+    if (!image) {
+        printf("Could not allocate %d bytes\n", padsize + 4);
+        return 1;
+    }
+    memcpy(image, g_filedata, size);
+    if (patch_mode && size >= 0x20)
+    {
+        memcpy(&image[0x14], &clock_freq, 4);
+        memcpy(&image[0x18], &clock_mode, 4);
+        memcpy(&image[0x1c], &user_baud, 4);
+    }
+    if (use_checksum)
+    {
+        checksum = 0x706f7250 - compute_checksum((int *)image, padsize/4);
+        memcpy(&image[padsize], &checksum, 4);
+        txbase64(image, padsize + 4, '?');
+        free(image);
+        check_single_response(fname);
+    }
+    else
+    {
+        txbase64(image, padsize, '~');
+        free(image);
+    }
+
+    wait_sent();
+    phase_end("single stage load");
+    if (verbose) printf("%s loaded\n", fname);
+    return 0;
+}
+
 int loadfilesingle(char *fname)
 {
     int num, size, i;
@@ -354,10 +882,14 @@ int loadfilesingle(char *fname)
     int checksum = 0;
 
     size = readBinaryFile(fname);
-    if (size < 0) {
+    if (size < 0 || !flat_image()) {
         return 1;
     }
     if (verbose) printf("Loading %s - %d bytes\n", fname, size);
+    phase_begin();
+    if (use_base64) {
+        return loadfilesingle_base64(fname, size);
+    }
     tx((uint8_t *)"> Prop_Hex 0 0 0 0", 18);
 
     while ((num=loadBytes(binbuffer, 128)))
@@ -388,28 +920,15 @@ int loadfilesingle(char *fname)
             sprintf( &buffer[i*3], " %2.2x", ptr[i] & 255 );
         tx( (uint8_t *)buffer, strlen(buffer) );
         tx((uint8_t *)"?", 1);
-        wait_drain();
-        msleep(100+fifo_size*10*1000/loader_baud);
-        num = rx_timeout((uint8_t *)buffer, 1, 100);
-        if (num >= 0) buffer[num] = 0;
-        else buffer[0] = 0;
-        if (strcmp(buffer, "."))
-        {
-            printf("%s failed to load\n", fname);
-            printf("Error response was \"%s\"\n", buffer);
-            promptexit(1);
-        }
-        if (verbose)
-            printf("Checksum validated\n");
+        check_single_response(fname);
     }
     else
     {
         tx((uint8_t *)"~", 1);   // Added for Prop2-v28
-        wait_drain();
-        msleep(fifo_size*10*1000/loader_baud);
     }
 
-    msleep(100);
+    wait_sent();
+    phase_end("single stage load");
     if (verbose) printf("%s loaded\n", fname);
     return 0;
 }
@@ -422,10 +941,10 @@ static unsigned flag_bits()
 
 int loadfileFPGA(char *fname, int address)
 {
-    int num, size;
-    int totnum = 0;
-    int patch = patch_mode;
-    unsigned chksum = 0;
+    int size;
+    int params[6];
+    uint8_t head[0x20];
+    int headlen = 0;
 
     size = readBinaryFile(fname);
     if (size < 0)
@@ -433,39 +952,36 @@ int loadfileFPGA(char *fname, int address)
         printf("Could not open %s\n", fname);
         return 1;
     }
+    if (!flat_image()) {
+        return 1;
+    }
     if (verbose) {
         printf("Loading fast loader for %s...\n", (load_mode == LOAD_FPGA) ? "fpga" : "chip");
     }
-    tx((uint8_t *)"> Prop_Hex 0 0 0 0", 18);
-    txstring((uint8_t *)MainLoader_fpga_bin, MainLoader_fpga_bin_len);
     // OLD FPGA loader
-    txval(clock_mode);
-    txval((3*clock_freq+loader_baud)/(loader_baud*2)-extra_cycles);
-    txval((clock_freq+loader_baud/2)/loader_baud-extra_cycles);
-    txval(size);
-    txval(address);
-    txval(flag_bits());
-    tx((uint8_t *)"~", 1);
+    params[0] = clock_mode;
+    params[1] = (3*clock_freq+loader_baud)/(loader_baud*2)-extra_cycles;
+    params[2] = (clock_freq+loader_baud/2)/loader_baud-extra_cycles;
+    params[3] = size;
+    params[4] = address;
+    params[5] = flag_bits();
+    txloader(MainLoader_fpga_bin, MainLoader_fpga_bin_len,
+             MainLoader_fpga_bin_txt, MainLoader_fpga_bin_txt_len, params, 6);
     msleep(200);
     if (verbose) printf("Loading %s - %d bytes\n", fname, size);
-    while ((num=loadBytes(buffer, 1024)))
+    if (patch_mode && size >= 0x20)
     {
-        int i;
-        if (patch)
-        {
-            patch = 0;
-            memcpy(&buffer[0x14], &clock_freq, 4);
-            memcpy(&buffer[0x18], &clock_mode, 4);
-            memcpy(&buffer[0x1c], &user_baud, 4);
-        }
-        tx((uint8_t *)buffer, num);
-        totnum += num;
-        for (i = 0; i < num; i++) {
-            chksum += buffer[i];
-        }
+        // the file itself is left alone; the patched values go out
+        // in a copy of its first few bytes
+        headlen = 0x20;
+        memcpy(head, g_filedata, headlen);
+        memcpy(&head[0x14], &clock_freq, 4);
+        memcpy(&head[0x18], &clock_mode, 4);
+        memcpy(&head[0x1c], &user_baud, 4);
+        tx(head, headlen);
     }
-    wait_drain();
-    msleep(100);
+    tx((uint8_t *)g_filedata + headlen, size - headlen);
+    wait_sent();
     if (verbose) printf("%s loaded\n", fname);
     return 0;
 }
@@ -497,156 +1013,1382 @@ static char *getNextFile(char *fname, char **next_p, int *address_p)
     return fname;
 }
 
-int loadfile(char *fname, int address)
+/* MainLoader_chip record types, sent in the top byte of the address */
+#define REC_DATA      0
+#define REC_FILL      1
+#define REC_RLE       2
+#define REC_INFO      3
+#define REC_HASH      4
+#define REC_FRAMED    5
+#define REC_READ      6
+#define REC_BAUD      7
+#define REC_START     8
+#define REC_WAIT      9
+#define REC_ADDR_MASK 0x00ffffff
+
+/* with -COMPRESS, runs of at least this many bytes go as a REC_FILL */
+#define FILL_MIN_RUN  4096
+
+/* bytes in each REC_FRAMED block, and how many times to try sending one */
+#define FRAME_BLOCK   1024
+#define FRAME_TRIES   8
+
+/* bytes in each block of a REC_READ reply, and how many times to read one */
+#define READ_BLOCK    1024
+#define READ_TRIES    4
+/* blocks asked for in each REC_READ, so that a lost byte costs little */
+#define READ_GROUP    8
+
+#define HUB_SIZE      0x80000
+
+/*
+ * with -XMEM, the external memory driver is loaded into HUB at
+ * XMEM_DRIVER, and each -XLOAD file is streamed to it in blocks of
+ * XMEM_BLOCK bytes, taking turns between two buffers at XMEM_BUFFER so
+ * that one can be sent while the driver copies the other. The driver's
+ * mailbox is three longs: a command with the external address in its
+ * low 28 bits, the HUB address, and the byte count; the driver clears
+ * bit 31 of the command when it is done, leaving 0 if all went well.
+ */
+#define XMEM_DRIVER   0x30000
+#define XMEM_BUFFER   0x40000
+#define XMEM_BLOCK    0x10000
+#define XMEM_WRITE    0xf0000000
+#define XMEM_ADDR_MASK 0x0fffffff
+
+#define MAX_XLOADS    16
+
+typedef struct xload {
+    unsigned address;   /* external memory address */
+    char *fname;
+} XLoad;
+
+static XLoad xloads[MAX_XLOADS];
+static int nxloads;
+
+/* clocks the loader needs per REC_RLE run, besides 2 per byte written */
+#define RLE_RUN_CLOCKS 24
+
+/*
+ * with -PIPELINE, up to PIPE_WINDOW records may be waiting for their
+ * checksums; after each one we send enough padding to cover the time
+ * the loader takes to finish it and answer, which is PIPE_CLOCKS plus
+ * 2 clocks for each long of a fill, and then PIPE_PAD more bytes
+ */
+#define PIPE_WINDOW   64
+#define PIPE_CLOCKS   256
+#define PIPE_PAD      4
+
+static int records_sent;
+static int rle_maxrun;
+static int loader_bytetime;
+static int record_clocks;
+static unsigned pending[PIPE_WINDOW];
+static int pending_first, npending;
+
+/*
+ * start a record: the loader wants a '+' before every record but the first
+ */
+static void begin_record(int type, unsigned address, unsigned size)
 {
-    int num, size;
-    int totnum = 0;
-    int patch = patch_mode;
-    unsigned chksum;
-    char *next_fname = NULL;
-    int send_size;
-    
-    if (load_mode == LOAD_SINGLE) {
-        if (address != 0) {
-            printf("ERROR: -SINGLE can only load at address 0\n");
-            promptexit(1);
-        }
-        return loadfilesingle(fname);
+    if (records_sent++) {
+        tx_raw_byte('+');
     }
-    if (load_mode == LOAD_FPGA) {
-        return loadfileFPGA(fname, address);
+    tx_raw_long((type << 24) | (address & REC_ADDR_MASK));
+    tx_raw_long(size);
+    record_clocks = type == REC_FILL ? size / 2 + 8 : 0;
+}
+
+/*
+ * read the loader's answer to a record: nreply bytes of data (if any)
+ * and then its checksum of the bytes it stored
+ * a long reply takes the loader a while to produce, so allow for that
+ */
+static int check_record(unsigned chksum, uint8_t *reply, int nreply)
+{
+    int num, recv_chksum;
+    int timeout = fifo_ms() + 400 + nreply / 4;
+
+    num = nreply ? rx_wait(reply, nreply, timeout) : 0;
+    if (num == nreply) {
+        num += rx_wait((uint8_t *)buffer, 3, fifo_ms() + 400);
+    }
+    if (num != nreply + 3) {
+        printf("ERROR: timeout waiting for checksum at end: got %d\n", num);
+        printf("Try increasing the FIFO setting if not large enough for your setup\n");
+        return 1;
+    }
+    recv_chksum = (buffer[0] - '@') << 4;
+    recv_chksum += (buffer[1] - '@');
+    chksum &= 0xff;
+    if (recv_chksum != chksum) {
+        printf("ERROR: bad checksum, expected %02x got %02x (chksum characters %c%c%c)\n", chksum, recv_chksum, buffer[0], buffer[1], buffer[2]);
+        promptexit(1);
+    }
+    if (verbose) printf("chksum: %x OK\n", recv_chksum);
+    return 0;
+}
+
+/* check the oldest record sent with -PIPELINE that is still unchecked */
+static int check_pending(void)
+{
+    unsigned chksum = pending[pending_first];
+
+    pending_first = (pending_first + 1) % PIPE_WINDOW;
+    npending--;
+    return check_record(chksum, NULL, 0);
+}
+
+/* check all the records sent with -PIPELINE that are still unchecked */
+static int flush_records(void)
+{
+    if (npending == 0) {
+        return 0;
+    }
+    wait_drain();
+    while (npending > 0) {
+        if (check_pending()) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * finish a record; usually we wait for the loader's answer, but with
+ * -PIPELINE a record that only answers with a checksum is followed by
+ * padding instead, and the checksum is checked later on
+ */
+static int end_record(unsigned chksum, uint8_t *reply, int nreply)
+{
+    static const uint8_t pad[64] = { 0 };
+    int n;
+
+    if (use_pipeline && nreply == 0) {
+        n = PIPE_PAD + (PIPE_CLOCKS + record_clocks) / loader_bytetime;
+        while (n > 0) {
+            tx((uint8_t *)pad, n < sizeof(pad) ? n : sizeof(pad));
+            n -= sizeof(pad);
+        }
+        if (npending == PIPE_WINDOW && check_pending()) {
+            return 1;
+        }
+        pending[(pending_first + npending++) % PIPE_WINDOW] = chksum;
+        return 0;
+    }
+    if (flush_records()) {
+        return 1;
+    }
+    wait_drain();
+    return check_record(chksum, reply, nreply);
+}
+
+static unsigned byte_sum(const uint8_t *data, int len)
+{
+    unsigned sum = 0;
+
+    while (len-- > 0) {
+        sum += *data++;
+    }
+    return sum;
+}
+
+/*
+ * send blocks first up to last of some data as a REC_FRAMED record, each
+ * followed by its CRC; the loader answers each block with "." if it
+ * arrived intact or "!" if not, and we put that in status[]
+ */
+static int send_frames(unsigned address, const uint8_t *data, int len,
+                       int first, int last, uint8_t *status)
+{
+    int start = first * FRAME_BLOCK;
+    int end = last * FRAME_BLOCK < len ? last * FRAME_BLOCK : len;
+    int i, n;
+
+    begin_record(REC_FRAMED, address + start, end - start);
+    for (i = start; i < end; i += FRAME_BLOCK) {
+        n = end - i < FRAME_BLOCK ? end - i : FRAME_BLOCK;
+        tx((uint8_t *)data + i, n);
+        tx_raw_long(crc32_msb_update(0, data + i, n));
+    }
+    if (end_record(0, status + first, last - first)) {
+        return 1;
+    }
+    for (i = first; i < last; i++) {
+        if (status[i] != '.' && status[i] != '!') {
+            printf("ERROR: bad reply for block %d: %02x\n", i, status[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * send data in CRC checked blocks, sending again just the blocks that
+ * were damaged on the way
+ */
+static int send_framed(unsigned address, const uint8_t *data, int len)
+{
+    int nblocks = (len + FRAME_BLOCK - 1) / FRAME_BLOCK;
+    uint8_t *status = malloc(nblocks);
+    int tries, first, last, bad;
+    int r = 0;
+
+    if (!status) {
+        printf("Could not allocate %d bytes\n", nblocks);
+        return 1;
+    }
+    memset(status, '!', nblocks);
+    for (tries = 1; r == 0; tries++) {
+        // send each run of blocks that have not yet arrived
+        for (first = 0; first < nblocks && r == 0; first = last) {
+            for (last = first; last < nblocks && status[last] == '!'; last++)
+                ;
+            if (last > first) {
+                r = send_frames(address, data, len, first, last, status);
+            } else {
+                last = first + 1;
+            }
+        }
+        for (bad = 0, first = 0; first < nblocks; first++) {
+            if (status[first] == '!') bad++;
+        }
+        if (bad == 0 || r != 0) {
+            break;
+        }
+        if (tries == FRAME_TRIES) {
+            printf("ERROR: %d blocks at %08x still bad after %d tries\n", bad, address, tries);
+            r = 1;
+            break;
+        }
+        if (verbose) printf("%08x: sending %d of %d blocks again\n", address, bad, nblocks);
+    }
+    free(status);
+    return r;
+}
+
+static int send_data(unsigned address, const uint8_t *data, int len)
+{
+    if (use_framing) {
+        return send_framed(address, data, len);
+    }
+    begin_record(REC_DATA, address, len);
+    tx((uint8_t *)data, len);
+    return end_record(byte_sum(data, len), NULL, 0);
+}
+
+static int send_fill(unsigned address, int value, int len)
+{
+    uint8_t v = value;
+
+    begin_record(REC_FILL, address, len);
+    tx(&v, 1);
+    return end_record(value * len, NULL, 0);
+}
+
+/*
+ * ask the loader how fast it is running, and work out from that how
+ * long a run it can write to HUB in the time it takes to receive the
+ * next byte; runs have to be limited to that or serial data is lost
+ */
+static int query_loader(void)
+{
+    uint8_t reply[4];
+    unsigned waitbit, bytetime;
+
+    begin_record(REC_INFO, 0, 0);
+    if (end_record(0, reply, 4)) {
+        return 1;
+    }
+    // the loader measures the time for 8 bits; a byte on the wire is 10
+    waitbit = reply[0] | (reply[1] << 8) | (reply[2] << 16) | (reply[3] << 24);
+    bytetime = waitbit * 10 / 8;
+    loader_bytetime = bytetime ? bytetime : 1;
+    if (bytetime < LOADER_BYTE_CLOCKS) {
+        printf("Warning: loader baud %d is too fast for the loader's clock; try -l %d\n",
+               loader_baud, (int)((unsigned long long)loader_baud * bytetime / LOADER_BYTE_CLOCKS));
+    }
+    rle_maxrun = ((int)(bytetime * 3 / 4) - RLE_RUN_CLOCKS) / 2;
+    if (rle_maxrun > RLE_MAXRUN) {
+        rle_maxrun = RLE_MAXRUN;
+    }
+    if (verbose) {
+        printf("Loader clock is about %d MHz, longest run %d bytes\n",
+               (int)((unsigned long long)waitbit * loader_baud / 8 / 1000000),
+               rle_maxrun < RLE_MINRUN ? 0 : rle_maxrun);
+    }
+    return 0;
+}
+
+/*
+ * send a stretch of the image run length encoded, or as it is if that
+ * would not make it any shorter
+ */
+static int send_packed(unsigned address, const uint8_t *data, int len)
+{
+    uint8_t *packed, *check;
+    int packedlen;
+    int r;
+
+    if (rle_maxrun < RLE_MINRUN) {
+        return send_data(address, data, len);
+    }
+    packed = malloc(RLE_MAX_ENCODED(len));
+    check = malloc(len);
+    if (!packed || !check) {
+        printf("Could not allocate %d bytes\n", RLE_MAX_ENCODED(len) + len);
+        promptexit(1);
+    }
+    packedlen = rle_encode(packed, data, len, rle_maxrun);
+    // a mistake here would only show up as a checksum error on the P2,
+    // so make sure the loader will get back what we started with
+    if (rle_decode(check, len, packed, packedlen) != packedlen
+        || memcmp(check, data, len) != 0)
+    {
+        printf("ERROR: compressed data does not match the original\n");
+        promptexit(1);
+    }
+    if (packedlen < len) {
+        if (verbose) printf("%08x: %d bytes packed to %d\n", address, len, packedlen);
+        begin_record(REC_RLE, address, len);
+        tx(packed, packedlen);
+        r = end_record(byte_sum(data, len), NULL, 0);
+    } else {
+        r = send_data(address, data, len);
+    }
+    free(check);
+    free(packed);
+    return r;
+}
+
+/*
+ * send an image compressed: long runs of one value are filled in by
+ * the loader, and what lies between them is run length encoded
+ */
+static int send_compressed(unsigned address, const uint8_t *data, int len)
+{
+    int start = 0;
+    int i = 0;
+    int run;
+
+    while (i < len) {
+        run = 1;
+        while (i + run < len && data[i + run] == data[i]) {
+            run++;
+        }
+        if (run >= FILL_MIN_RUN) {
+            if (i > start && send_packed(address + start, data + start, i - start)) {
+                return 1;
+            }
+            if (send_fill(address + i, data[i], run)) {
+                return 1;
+            }
+            start = i + run;
+        }
+        i += run;
+    }
+    if (start < len) {
+        return send_packed(address + start, data + start, len - start);
+    }
+    return 0;
+}
+
+static int send_block(unsigned address, const uint8_t *data, int len)
+{
+    if (use_compression) {
+        return send_compressed(address, data, len);
+    }
+    return send_data(address, data, len);
+}
+
+/*
+ * send only the parts of a block that differ from what is in HUB
+ * already, going by the CRCs the loader reports for it; the loader
+ * hashes whole longs, so any odd bytes at the end are always sent
+ */
+static int send_changed(unsigned address, const uint8_t *data, int len)
+{
+    int hashlen = len & ~3;
+    int nblocks = DELTA_BLOCKS(hashlen);
+    uint8_t *reply = malloc(nblocks * 4 + 1);
+    uint32_t *hashes = malloc(nblocks * sizeof(uint32_t) + 1);
+    DeltaRun *runs = malloc((nblocks / 2 + 2) * sizeof(DeltaRun));
+    int nruns, sent, i;
+    int r;
+
+    if (!reply || !hashes || !runs) {
+        printf("Could not allocate memory for %d block hashes\n", nblocks);
+        promptexit(1);
+    }
+    begin_record(REC_HASH, address, hashlen);
+    r = end_record(0, reply, nblocks * 4);
+    if (r == 0) {
+        for (i = 0; i < nblocks; i++) {
+            hashes[i] = reply[4*i] | (reply[4*i+1] << 8) | (reply[4*i+2] << 16) | ((uint32_t)reply[4*i+3] << 24);
+        }
+        nruns = delta_diff(data, hashlen, hashes, runs);
+        if (hashlen < len) {
+            if (nruns > 0 && runs[nruns-1].offset + runs[nruns-1].len == hashlen) {
+                runs[nruns-1].len += len - hashlen;
+            } else {
+                runs[nruns].offset = hashlen;
+                runs[nruns].len = len - hashlen;
+                nruns++;
+            }
+        }
+        sent = 0;
+        for (i = 0; i < nruns && r == 0; i++) {
+            r = send_block(address + runs[i].offset, data + runs[i].offset, runs[i].len);
+            sent += runs[i].len;
+        }
+        if (verbose) printf("%08x: %d of %d bytes changed\n", address, sent, len);
+    }
+    free(runs);
+    free(hashes);
+    free(reply);
+    return r;
+}
+
+/*
+ * -CHIP loads send files straight from memory, but a size prefix or the
+ * -PATCH values go out in a copy of this much of the start of the image;
+ * a whole delta block, so that the rest stays block aligned
+ */
+#define COPY_BLOCK DELTA_BLOCK
+
+/*
+ * send one region of an image: its data, and then a fill to zero the
+ * rest of its memory
+ */
+static int send_region(unsigned address, const uint8_t *data, int filesz, int memsz)
+{
+    int r = 0;
+
+    if (filesz > 0) {
+        if (use_delta) {
+            r = send_changed(address, data, filesz);
+        } else {
+            r = send_block(address, data, filesz);
+        }
+    }
+    if (r == 0 && memsz > filesz) {
+        r = send_fill(address + filesz, 0, memsz - filesz);
+    }
+    return r;
+}
+
+/*
+ * with -ZERO, -CHIP loads clear only the HUB memory below HUB_ZERO_TOP
+ * that nothing was loaded into, and with -VERIFY the loaded memory is
+ * checked before the program is started, so we keep track of what was
+ * loaded
+ */
+#define HUB_ZERO_TOP 0x7c000
+
+typedef struct hub_range {
+    unsigned start;
+    unsigned end;
+    uint32_t *crcs;     /* with -VERIFY, the block CRCs it should have */
+} HubRange;
+
+static HubRange *loaded_ranges;
+static int nloaded, maxloaded;
+
+static void forget_loaded(void)
+{
+    while (nloaded > 0) {
+        free(loaded_ranges[--nloaded].crcs);
+    }
+}
+
+/*
+ * note that memsz bytes at address were loaded, the first filesz of
+ * them from data and the rest zeroed
+ */
+static void note_loaded(unsigned address, const uint8_t *data, int filesz, int memsz)
+{
+    uint8_t *mem;
+    uint32_t *crcs = NULL;
+    int hashlen = memsz & ~3;
+
+    if (use_verify && hashlen > 0) {
+        mem = calloc(memsz, 1);
+        crcs = malloc(DELTA_BLOCKS(hashlen) * sizeof(uint32_t));
+        if (!mem || !crcs) {
+            printf("Could not allocate %d bytes\n", memsz);
+            promptexit(1);
+        }
+        memcpy(mem, data, filesz);
+        delta_hash(mem, hashlen, crcs);
+        free(mem);
+    }
+    if (nloaded == maxloaded) {
+        maxloaded = maxloaded ? 2 * maxloaded : 16;
+        loaded_ranges = realloc(loaded_ranges, maxloaded * sizeof(HubRange));
+        if (!loaded_ranges) {
+            printf("Could not allocate memory for %d ranges\n", maxloaded);
+            promptexit(1);
+        }
+    }
+    loaded_ranges[nloaded].start = address;
+    loaded_ranges[nloaded].end = address + memsz;
+    loaded_ranges[nloaded].crcs = crcs;
+    nloaded++;
+}
+
+static int range_cmp(const void *a, const void *b)
+{
+    unsigned x = ((const HubRange *)a)->start;
+    unsigned y = ((const HubRange *)b)->start;
+
+    return x < y ? -1 : x > y;
+}
+
+static int zero_unloaded(void)
+{
+    unsigned addr = 0;
+    int i;
+
+    qsort(loaded_ranges, nloaded, sizeof(HubRange), range_cmp);
+    for (i = 0; i <= nloaded && addr < HUB_ZERO_TOP; i++) {
+        unsigned next = i < nloaded ? loaded_ranges[i].start : HUB_ZERO_TOP;
+
+        if (next > HUB_ZERO_TOP) {
+            next = HUB_ZERO_TOP;
+        }
+        if (next > addr) {
+            if (verbose) printf("  zeroing %08x: %d bytes\n", addr, next - addr);
+            if (send_fill(addr, 0, next - addr)) {
+                return 1;
+            }
+        }
+        if (i < nloaded && loaded_ranges[i].end > addr) {
+            addr = loaded_ranges[i].end;
+        }
+    }
+    return 0;
+}
+
+/*
+ * have the loader hash everything that was loaded, and compare that
+ * with what the files say should be there; any odd bytes at the end
+ * of a range are only covered by the usual checksum
+ */
+static int verify_loaded(void)
+{
+    int hashlen, nblocks, bad, i, j;
+    uint32_t crc;
+    uint8_t *reply;
+
+    for (i = 0; i < nloaded; i++) {
+        if (!loaded_ranges[i].crcs) {
+            continue;
+        }
+        hashlen = (loaded_ranges[i].end - loaded_ranges[i].start) & ~3;
+        nblocks = DELTA_BLOCKS(hashlen);
+        reply = malloc(nblocks * 4);
+        if (!reply) {
+            printf("Could not allocate %d bytes\n", nblocks * 4);
+            promptexit(1);
+        }
+        begin_record(REC_HASH, loaded_ranges[i].start, hashlen);
+        if (end_record(0, reply, nblocks * 4)) {
+            free(reply);
+            return 1;
+        }
+        bad = 0;
+        for (j = 0; j < nblocks; j++) {
+            crc = reply[4*j] | (reply[4*j+1] << 8) | (reply[4*j+2] << 16) | ((uint32_t)reply[4*j+3] << 24);
+            if (crc != loaded_ranges[i].crcs[j]) {
+                printf("ERROR: HUB memory at %08x does not match what was loaded\n",
+                       loaded_ranges[i].start + j * DELTA_BLOCK);
+                bad++;
+            }
+        }
+        free(reply);
+        if (bad) {
+            return 1;
+        }
+        if (verbose) printf("  verified %08x: %d bytes\n", loaded_ranges[i].start, hashlen);
+    }
+    return 0;
+}
+
+/*
+ * the first $80 lets the loader measure the baud rate, the next one
+ * is checked against that, and if it's OK the loader answers with an
+ * "@@ " checksum. If the loader wasn't running yet when the first one
+ * arrived the second is taken for autobaud, so retry with single
+ * characters until it answers.
+ * the caller must have let everything before this get through the
+ * adapter's FIFO, or the first $80 arrives before the loader is ready
+ * returns 0 if it answered, 1 on a timeout (with the number of bytes
+ * received in *num) or 2 on a bad answer, which is left in buffer
+ */
+static int loader_handshake(int *num)
+{
+    int retry;
+    // a few characters each way, and the adapter's receive latency
+    int timeout = fifo_ms() + 20 + 5*10*1000/loader_baud;
+
+    flush_input();
+    tx_raw_byte(0x80);
+    wait_drain();
+    msleep(1); // give the loader time to set up its smart pins
+    for (retry = 0; retry < 10; retry++) {
+        tx_raw_byte(0x80);
+        *num = rx_wait((uint8_t *)buffer, 3, timeout);
+        if (*num == 3) break;
+    }
+    if (*num != 3) {
+        return 1;
+    }
+    // every so often we get a 0 byte first before the checksum; if
+    // we do, throw it away
+    if (buffer[0] == 0 && buffer[2] == '@') {
+        buffer[0] = buffer[2];
+        rx_wait((uint8_t *)&buffer[2], 1, 100);
+    }
+    if (buffer[0] != '@' || buffer[1] != '@') {
+        return 2;
+    }
+    records_sent = 0;
+    return 0;
+}
+
+/*
+ * send MainLoader_chip to the P2 through the ROM, and wait for it to
+ * be ready for records; the caller has started the phase timer
+ * returns 0 on success; a failure exits, unless the port came from the
+ * cache without being probed, when it returns 1 so the caller can go
+ * looking for the P2
+ */
+static int start_chip_loader(void)
+{
+    int num, r;
+    int params[2];
+
+    params[0] = clock_mode;
+    // the chip loader is told what to zero with fill records instead
+    params[1] = flag_bits() & ~1;
+    txloader(MainLoader_chip_bin, MainLoader_chip_bin_len,
+             MainLoader_chip_bin_txt, MainLoader_chip_bin_txt_len, params, 2);
+    // the loader only starts once the ROM has all of it
+    wait_sent();
+    phase_end("loader bootstrap");
+
+    r = loader_handshake(&num);
+    if (r && cache_unverified) {
+        if (verbose) printf("No loader answer on cached port\n");
+        return 1;
+    }
+    switch (r) {
+    case 1:
+        printf("ERROR: timeout waiting for initial checksum: got %d\n", num);
+        printf("Try increasing the FIFO setting if not large enough for your setup\n");
+        promptexit(1);
+        break;
+    case 2:
+        printf("ERROR: got incorrect initial chksum: %c%c%c (%02x %02x %02x)\n", buffer[0], buffer[1], buffer[2], buffer[0], buffer[1], buffer[2]);
+        promptexit(1);
+        break;
+    }
+    phase_end("autobaud handshake");
+    cache_unverified = 0;
+    npending = 0;
+    forget_loaded();
+    return 0;
+}
+
+/*
+ * with -l auto the loader is started at the usual rate and then moved up
+ * through these rates, as far as its clock allows, each one being checked
+ * with a test pattern that the loader has to store and hash back to us;
+ * the pattern goes where the ROM put the loader, so nothing is lost
+ */
+static const int baud_ladder[] = { 3000000, 4000000, 6000000, LOADER_MAX_BAUD, 0 };
+
+#define BAUD_TEST_ADDR 0
+#define BAUD_TEST_LEN  1024
+
+/*
+ * have the loader measure the baud rate again, and switch to the new
+ * rate; if the last rate tried failed the loader may still be part way
+ * through a record, so first send enough $ff bytes to finish it off
+ * (and to be skipped as padding or ignored as a record type)
+ * returns 0 if the loader answered at the new rate
+ */
+static int change_loader_baud(int baud, int unstick)
+{
+    static uint8_t pad[64];
+    int num, n;
+
+    if (unstick) {
+        memset(pad, 0xff, sizeof(pad));
+        for (n = 0; n < BAUD_TEST_LEN + 16; n += sizeof(pad)) {
+            tx(pad, sizeof(pad));
+        }
+        records_sent = 1;
+    }
+    begin_record(REC_BAUD, 0, 0);
+    wait_sent();
+    if (!serial_baud(baud)) {
+        return 1;
+    }
+    loader_baud = baud;
+    return loader_handshake(&num);
+}
+
+/*
+ * send the test pattern and ask for its hash; any mistake in either
+ * direction shows up as a wrong checksum or CRC, or a timeout
+ * returns 0 if everything came back as it should
+ */
+static int test_loader_baud(void)
+{
+    uint8_t pattern[BAUD_TEST_LEN];
+    uint8_t reply[7];
+    unsigned seed = loader_baud;
+    unsigned chksum;
+    uint32_t crc;
+    int i;
+
+    for (i = 0; i < BAUD_TEST_LEN; i++) {
+        seed = seed * 1103515245 + 12345;
+        pattern[i] = seed >> 16;
+    }
+    chksum = byte_sum(pattern, BAUD_TEST_LEN) & 0xff;
+    begin_record(REC_DATA, BAUD_TEST_ADDR, BAUD_TEST_LEN);
+    tx(pattern, BAUD_TEST_LEN);
+    wait_drain();
+    if (rx_wait(reply, 3, fifo_ms() + 100) != 3
+        || reply[0] != '@' + (chksum >> 4) || reply[1] != '@' + (chksum & 15))
+    {
+        return 1;
+    }
+    begin_record(REC_HASH, BAUD_TEST_ADDR, BAUD_TEST_LEN);
+    wait_drain();
+    if (rx_wait(reply, 7, fifo_ms() + 100) != 7 || reply[4] != '@' || reply[5] != '@') {
+        return 1;
+    }
+    crc = reply[0] | (reply[1] << 8) | (reply[2] << 16) | ((uint32_t)reply[3] << 24);
+    return crc != crc32_update(0, pattern, BAUD_TEST_LEN);
+}
+
+/*
+ * with -l auto, find the fastest rate that both the loader and the USB
+ * adapter manage; the rate that worked last time with this adapter is
+ * tried first, and if it still works the ladder is skipped. The loader
+ * is left at the best rate that passed; if it can't be got back to that
+ * the P2 is reset and the loader started again at the usual rate.
+ */
+static int climb_loader_baud(void)
+{
+    int start = loader_baud;
+    int good = loader_baud;
+    int limit = (unsigned long long)loader_baud * loader_bytetime / LOADER_BYTE_CLOCKS;
+    int failed = 0;
+    int found = 0;
+    int i;
+
+    if (cached_loader_baud > good && cached_loader_baud <= limit) {
+        if (change_loader_baud(cached_loader_baud, 0) == 0 && test_loader_baud() == 0) {
+            good = cached_loader_baud;
+            found = 1;
+        } else {
+            if (verbose) printf("Loader baud %d no longer works\n", cached_loader_baud);
+            failed = 1;
+        }
+    }
+    for (i = 0; !found && baud_ladder[i] && baud_ladder[i] <= limit; i++) {
+        if (baud_ladder[i] <= good) {
+            continue;
+        }
+        if (change_loader_baud(baud_ladder[i], failed) || test_loader_baud()) {
+            if (verbose) printf("Loader baud %d failed\n", baud_ladder[i]);
+            failed = 1;
+            break;
+        }
+        if (verbose) printf("Loader baud %d OK\n", baud_ladder[i]);
+        good = baud_ladder[i];
+        failed = 0;
+    }
+    // settling on a rate also has the loader forget the test pattern's
+    // address, which it would otherwise take as the starting address
+    if (change_loader_baud(good, failed)) {
+        if (!do_hwreset || !serial_baud(start)) {
+            printf("ERROR: lost the loader while changing baud rate\n");
+            return 1;
+        }
+        printf("Lost the loader while changing baud rate; starting again at %d\n", start);
+        loader_baud = start;
+        hwreset();
+        msleep(20);
+        start_chip_loader();
+    }
+    phase_end("baud rate search");
+    check_loader_baud();
+    return query_loader();
+}
+
+/* store a long in a little endian byte buffer */
+static void put_long(uint8_t *p, unsigned v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/*
+ * wait for the external memory driver to finish whatever it was last
+ * asked to do, and check that it worked; with stop set the loader then
+ * stops the driver, so that loading the program over its mailbox can't
+ * look like another command
+ */
+static int wait_xmem(int stop)
+{
+    uint8_t reply[4];
+    unsigned result;
+
+    begin_record(REC_WAIT, xmem_mailbox, stop);
+    if (end_record(0, reply, 4)) {
+        return 1;
+    }
+    result = reply[0] | (reply[1] << 8) | (reply[2] << 16) | ((unsigned)reply[3] << 24);
+    if (result != 0) {
+        printf("ERROR: external memory driver failed with %08x\n", result);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * have the driver copy len bytes from HUB at bufaddr to external memory
+ * at extaddr; the arguments are written first, in their own record, so
+ * that the driver can't see the command before they are there
+ */
+static int post_xmem(unsigned bufaddr, unsigned extaddr, int len)
+{
+    uint8_t args[8];
+    uint8_t cmd[4];
+
+    put_long(args, bufaddr);
+    put_long(args + 4, len);
+    put_long(cmd, xmem_command | extaddr);
+    if (send_data(xmem_mailbox + 4, args, 8)) {
+        return 1;
+    }
+    return send_data(xmem_mailbox, cmd, 4);
+}
+
+/*
+ * load the external memory driver into HUB and start it, with an empty
+ * mailbox; the loader stops it once the last block is written
+ */
+static int start_xmem(void)
+{
+    static const uint8_t empty[12];
+    uint8_t *driver;
+    FILE *f;
+    int len, num, cog;
+
+    f = fopen(xmem_driver, "rb");
+    if (!f) {
+        perror(xmem_driver);
+        return 1;
+    }
+    driver = malloc(XMEM_BUFFER - XMEM_DRIVER + 1);
+    if (!driver) {
+        printf("Could not allocate %d bytes\n", XMEM_BUFFER - XMEM_DRIVER + 1);
+        fclose(f);
+        return 1;
+    }
+    len = fread(driver, 1, XMEM_BUFFER - XMEM_DRIVER + 1, f);
+    fclose(f);
+    if (len <= 0 || len > XMEM_BUFFER - XMEM_DRIVER) {
+        printf("ERROR: external memory driver %s must be 1 to %d bytes\n", xmem_driver, XMEM_BUFFER - XMEM_DRIVER);
+        free(driver);
+        return 1;
+    }
+    if (send_data(xmem_mailbox, empty, sizeof(empty)) || send_block(XMEM_DRIVER, driver, len)) {
+        free(driver);
+        return 1;
+    }
+    free(driver);
+    if (flush_records()) {
+        return 1;
+    }
+    // the loader answers with the driver's cog number instead of a checksum
+    begin_record(REC_START, XMEM_DRIVER, xmem_mailbox);
+    wait_drain();
+    num = rx_wait((uint8_t *)buffer, 3, fifo_ms() + 400);
+    if (num != 3) {
+        printf("ERROR: timeout waiting for external memory driver to start: got %d\n", num);
+        return 1;
+    }
+    cog = ((buffer[0] - '@') << 4) + (buffer[1] - '@');
+    if (cog > 7) {
+        printf("ERROR: no free cog for external memory driver\n");
+        return 1;
+    }
+    if (verbose) printf("External memory driver %s started in cog %d\n", xmem_driver, cog);
+    return 0;
+}
+
+/*
+ * stream a file to external memory at extaddr, a block at a time, so
+ * that only one block of it is ever in memory here however big it is;
+ * each block goes to the HUB buffer the driver is not busy with, and
+ * is handed over once the driver has finished with the other one
+ */
+static int load_xmem(unsigned extaddr, const char *fname)
+{
+    uint8_t *block;
+    unsigned bufaddr;
+    FILE *f;
+    int n, which = 0;
+    int r = 0;
+    long total = 0;
+
+    f = fopen(fname, "rb");
+    if (!f) {
+        perror(fname);
+        return 1;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    // have the OS read ahead of us while we send
+    posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    block = malloc(XMEM_BLOCK);
+    if (!block) {
+        printf("Could not allocate %d bytes\n", XMEM_BLOCK);
+        fclose(f);
+        return 1;
+    }
+    while (r == 0 && (n = fread(block, 1, XMEM_BLOCK, f)) > 0) {
+        if (extaddr + n - 1 > XMEM_ADDR_MASK || extaddr + n - 1 < extaddr) {
+            printf("ERROR: %s does not fit in external memory at %08x\n", fname, extaddr);
+            r = 1;
+            break;
+        }
+        bufaddr = XMEM_BUFFER + which * XMEM_BLOCK;
+        r = send_block(bufaddr, block, n) || wait_xmem(0) || post_xmem(bufaddr, extaddr, n);
+        extaddr += n;
+        total += n;
+        which ^= 1;
+    }
+    if (r == 0 && ferror(f)) {
+        printf("Error reading %s\n", fname);
+        r = 1;
+    }
+    if (r == 0 && verbose) printf("Streamed %s - %ld bytes\n", fname, total);
+    free(block);
+    fclose(f);
+    return r;
+}
+
+/*
+ * start the external memory driver and stream all the -XLOAD files to
+ * it, before anything is put in HUB for the program itself
+ */
+static int load_external(void)
+{
+    int i;
+
+    if (start_xmem()) {
+        return 1;
+    }
+    for (i = 0; i < nxloads; i++) {
+        if (load_xmem(xloads[i].address, xloads[i].fname)) {
+            return 1;
+        }
+        phase_end(xloads[i].fname);
+    }
+    // the last block must be in place before HUB can be reused
+    return wait_xmem(1);
+}
+
+// pick the clock mode to suit the load mode
+static void set_clock_mode(void)
+{
+    if (load_mode == LOAD_CHIP)
+    {
+        if (clock_mode == -1)
+        {
+            clock_mode = get_clock_mode(clock_freq);
+            if (verbose) printf("Setting clock_mode to %x\n", clock_mode);
+        }
+    }
+    else if (load_mode == LOAD_FPGA)
+    {
+        int temp = clock_freq / 312500; // * 256 / 80000000
+        int temp1 = temp - 1;
+        if (clock_mode == -1)
+        {
+            clock_mode = temp1;
+            if (verbose) printf("Setting clock_mode to %x\n", temp1);
+        }
+    }
+    else if (load_mode == -1)
+    {
+        load_mode = LOAD_SINGLE;
+        if (verbose) printf("Setting load mode to SINGLE\n");
+    }
+}
+
+int loadfile(char *fname, int address)
+{
+    int size;
+    int patch = patch_mode;
+    char *next_fname = NULL;
+    int send_size;
+    int prefix, len, r, i;
+    int first = 1;
+    int start, filesz, memsz;
+    const uint8_t *data;
+    uint8_t head[COPY_BLOCK];
+    int headlen, headmem;
+    const LoadRegion *regions;
+    LoadRegion whole;
+    int nregions;
+    unsigned long long load_start;
+    
+    if (nxloads && load_mode != LOAD_CHIP) {
+        printf("ERROR: -XMEM and -XLOAD need -CHIP mode\n");
+        return 1;
+    }
+    if (load_mode == LOAD_SINGLE) {
+        if (address != 0) {
+            printf("ERROR: -SINGLE can only load at address 0\n");
+            promptexit(1);
+        }
+        return loadfilesingle(fname);
+    }
+    if (load_mode == LOAD_FPGA) {
+        return loadfileFPGA(fname, address);
+    }
+    
+    if (verbose) {
+        printf("Loading fast loader for %s...\n", (load_mode == LOAD_FPGA) ? "fpga" : "chip");
+    }
+    phase_begin();
+    load_start = phase_start;
+    if (start_chip_loader()) {
+        return LOADFILE_RETRY;
+    }
+    if ((use_compression || use_pipeline || loader_baud_auto) && query_loader()) {
+        return 1;
+    }
+    if (loader_baud_auto && climb_loader_baud()) {
+        return 1;
+    }
+    if (nxloads && load_external()) {
+        return 1;
+    }
+
+    // we want to be able to insert 0 characters in fname
+    // in order to break up multiple file names into different strings
+    // so we have to copy it to a duplicate buffer
+    fname = duplicate_string(fname);
+    
+    do {
+        fname = getNextFile(fname, &next_fname, &address);
+        if (!next_fname) break; /* no more files */
+
+        if (*next_fname == '+') {
+            next_fname++;
+            send_size = 1;
+        } else {
+            send_size = 0;
+        }
+        size = readBinaryFile(next_fname);
+        if (size < 0)
+        {
+            printf("Could not open %s\n", next_fname);
+            return 1;
+        }
+
+        // a + in the file spec puts the size in memory before the data
+        prefix = send_size ? 4 : 0;
+        len = size + prefix;
+        if (len == 0) {
+            printf("ERROR: %s is empty\n", next_fname);
+            return 1;
+        }
+        regions = g_regions;
+        nregions = g_nregions;
+        if (patch && size >= 0x20 && regions[0].filesz < 0x20) {
+            // the -PATCH values are not all in the first segment's
+            // data, so send the image in one piece
+            if (!flat_image()) {
+                return 1;
+            }
+            whole.offset = 0;
+            whole.data = g_filedata;
+            whole.filesz = whole.memsz = size;
+            regions = &whole;
+            nregions = 1;
+        }
+        // the file is sent from where it sits in memory, except that
+        // the size and the -PATCH values go out in a copy of its first
+        // block
+        headlen = 0;
+        if (prefix || (patch && size >= 0x20)) {
+            headlen = prefix + regions[0].filesz;
+            if (headlen > COPY_BLOCK) headlen = COPY_BLOCK;
+            memcpy(head, &size, prefix);
+            memcpy(head + prefix, regions[0].data, headlen - prefix);
+            if (patch && headlen >= prefix + 0x20)
+            {
+                memcpy(&head[prefix+0x14], &clock_freq, 4);
+                memcpy(&head[prefix+0x18], &clock_mode, 4);
+                memcpy(&head[prefix+0x1c], &user_baud, 4);
+            }
+        }
+        patch = 0;
+
+        if (verbose) printf("Loading %s - %d bytes\n", next_fname, size);
+        r = 0;
+        for (i = 0; i < nregions && r == 0; i++) {
+            start = regions[i].offset + prefix;
+            data = regions[i].data;
+            filesz = regions[i].filesz;
+            memsz = regions[i].memsz;
+            if (i == 0) {
+                // the first record gives the starting address, so it
+                // always starts at the beginning of the image (the
+                // first region is always at offset 0)
+                filesz += prefix;
+                memsz += prefix;
+                start = 0;
+                if (first && use_delta) {
+                    // the start may already be loaded, in which case
+                    // an empty fill tells the loader where it is
+                    r = send_fill(address, 0, 0);
+                }
+                first = 0;
+            }
+            if (verbose && nregions > 1) {
+                printf("  segment at %08x: %d bytes", address + start, filesz);
+                if (memsz > filesz) printf(", %d zeroed", memsz - filesz);
+                printf("\n");
+            }
+            if (i == 0 && headlen > 0 && r == 0) {
+                headmem = headlen == filesz ? memsz : headlen;
+                r = send_region(address, head, headlen, headmem);
+                note_loaded(address, head, headlen, headmem);
+                start = headlen;
+                data += headlen - prefix;
+                filesz -= headlen;
+                memsz -= headmem;
+            }
+            if (r == 0 && memsz > 0) {
+                r = send_region(address + start, data, filesz, memsz);
+                note_loaded(address + start, data, filesz, memsz);
+            }
+        }
+        if (r) {
+            return 1;
+        }
+        address += len;
+        phase_end(next_fname);
+    } while (*fname);
+    if (force_zero && zero_unloaded()) {
+        return 1;
+    }
+    if (use_verify && verify_loaded()) {
+        return 1;
+    }
+    if (flush_records()) {
+        return 1;
+    }
+    // no more records
+    tx_raw_byte('-');
+    wait_sent();
+    if (verbose) printf("  %-24s %6llu ms\n", "total", elapsedms() - load_start);
+    return 0;
+}
+
+/*
+ * ask the loader for len bytes of HUB at address, which must be no more
+ * than READ_GROUP blocks, and check each block against its CRC
+ * returns 0 if they all arrived intact, 1 if not
+ */
+static int read_group(unsigned address, uint8_t *buf, int len, uint8_t *reply)
+{
+    int nreply = len + 4 * ((len + READ_BLOCK - 1) / READ_BLOCK);
+    // twice the time on the wire, plus the adapter's FIFO and latency
+    int timeout = fifo_ms() + 50 + (int)((nreply + 3) * 20000LL / loader_baud);
+    uint8_t *p = reply;
+    uint32_t crc;
+    int i, n, num;
+
+    begin_record(REC_READ, address, len);
+    if (flush_records()) {
+        return 1;
+    }
+    wait_drain();
+    num = rx_wait(reply, nreply, timeout);
+    if (num == nreply) {
+        num += rx_wait((uint8_t *)buffer, 3, fifo_ms() + 50);
+    }
+    if (num != nreply + 3 || buffer[0] != '@' || buffer[1] != '@') {
+        if (verbose) printf("%08x: got %d of %d bytes\n", address, num, nreply + 3);
+        return 1;
+    }
+    for (i = 0; i < len; i += READ_BLOCK) {
+        n = len - i < READ_BLOCK ? len - i : READ_BLOCK;
+        crc = p[n] | (p[n+1] << 8) | (p[n+2] << 16) | ((uint32_t)p[n+3] << 24);
+        if (crc != crc32_update(0, p, n)) {
+            if (verbose) printf("%08x: bad CRC\n", address + i);
+            return 1;
+        }
+        memcpy(buf + i, p, n);
+        p += n + 4;
+    }
+    return 0;
+}
+
+/*
+ * read len bytes of HUB at address into buf, READ_GROUP blocks at a
+ * time; a group that arrives damaged, or not at all, is read again
+ */
+static int read_hub(unsigned address, uint8_t *buf, int len)
+{
+    uint8_t *reply = malloc(READ_GROUP * (READ_BLOCK + 4));
+    uint8_t junk[256];
+    int i, n, tries;
+
+    if (!reply) {
+        printf("Could not allocate %d bytes\n", READ_GROUP * (READ_BLOCK + 4));
+        return 1;
+    }
+    for (i = 0; i < len; i += n) {
+        n = len - i < READ_GROUP * READ_BLOCK ? len - i : READ_GROUP * READ_BLOCK;
+        for (tries = 1; read_group(address + i, buf + i, n, reply); tries++) {
+            if (tries == READ_TRIES) {
+                printf("ERROR: HUB at %08x could not be read after %d tries\n", address + i, tries);
+                free(reply);
+                return 1;
+            }
+            if (verbose) printf("%08x: reading again\n", address + i);
+            // let whatever is left of the last reply go by first
+            while (rx_wait(junk, sizeof(junk), 20) > 0)
+                ;
+        }
+    }
+    free(reply);
+    return 0;
+}
+
+/*
+ * save memory read from the P2; a name ending in .elf gets an ELF core
+ * file with the memory as its only segment, anything else the bytes
+ */
+static int write_dump(const char *fname, unsigned address, const uint8_t *data, int len)
+{
+    ElfHdr hdr;
+    ElfProgramHdr phdr;
+    FILE *f;
+    int n = strlen(fname);
+    int ok = 1;
+
+    f = fopen(fname, "wb");
+    if (!f) {
+        printf("Could not create %s\n", fname);
+        return 1;
+    }
+    if (n > 4 && (!strcmp(fname + n - 4, ".elf") || !strcmp(fname + n - 4, ".ELF"))) {
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.ident, "\177ELF\001\001\001", 7);
+        hdr.type = 4;       /* ET_CORE */
+        hdr.version = 1;
+        hdr.phoff = sizeof(hdr);
+        hdr.ehsize = sizeof(hdr);
+        hdr.phentsize = sizeof(phdr);
+        hdr.phnum = 1;
+        memset(&phdr, 0, sizeof(phdr));
+        phdr.type = PT_LOAD;
+        phdr.offset = sizeof(hdr) + sizeof(phdr);
+        phdr.vaddr = phdr.paddr = address;
+        phdr.filesz = phdr.memsz = len;
+        phdr.flags = 7;     /* read, write, execute */
+        phdr.align = 4;
+        ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fwrite(&phdr, sizeof(phdr), 1, f) == 1;
+    }
+    ok = ok && fwrite(data, 1, len, f) == (size_t)len;
+    if (fclose(f) != 0 || !ok) {
+        printf("Error writing %s\n", fname);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * start the loader and have it send back len bytes of HUB at address,
+ * which are saved to fname; the loader is left waiting afterwards
+ */
+int dumpfile(unsigned address, int len, char *fname)
+{
+    uint8_t *buf = malloc(len);
+    int r;
+
+    if (!buf) {
+        printf("Could not allocate %d bytes\n", len);
+        return 1;
     }
-    
-    if (verbose) {
-        printf("Loading fast loader for %s...\n", (load_mode == LOAD_FPGA) ? "fpga" : "chip");
+    if (verbose) printf("Loading fast loader for chip...\n");
+    phase_begin();
+    if (start_chip_loader()) {
+        free(buf);
+        return 1;
     }
-    tx((uint8_t *)"> Prop_Hex 0 0 0 0", 18);
-    txstring((uint8_t *)MainLoader_chip_bin, MainLoader_chip_bin_len);
-    txval(clock_mode);
-    txval(flag_bits());
-    tx((uint8_t *)"~", 1);
-    
-    {
-        int retry;
-        // receive checksum, verify it's "@@ "
-        wait_drain();
-        msleep(1+fifo_size*10*1000/loader_baud); // wait for external USB fifo to drain
-        flush_input();
-        msleep(50); // wait for code to start up
-        tx_raw_byte(0x80);
-        wait_drain();
-        msleep(2);
-        for (retry = 0; retry < 5; retry++) {
-            // send autobaud character
-            tx_raw_byte(0x80);
-            wait_drain();
-            msleep(10);
-            num = rx_timeout((uint8_t *)buffer, 3, 200);
-            if (num == 3) break;
-        }
-        if (num != 3) {
-            printf("ERROR: timeout waiting for initial checksum: got %d\n", num);
-            printf("Try increasing the FIFO setting if not large enough for your setup\n");
-            promptexit(1);
-        }
-        // every so often we get a 0 byte first before the checksum; if
-        // we do, throw it away
-        if (buffer[0] == 0 && buffer[2] == '@') {
-            buffer[0] = buffer[2];
-            rx_timeout((uint8_t *)&buffer[2], 1, 100);
-        }
-        if (buffer[0] != '@' || buffer[1] != '@') {
-            printf("ERROR: got incorrect initial chksum: %c%c%c (%02x %02x %02x)\n", buffer[0], buffer[1], buffer[2], buffer[0], buffer[1], buffer[2]);
-            promptexit(1);
-        }
+    r = read_hub(address, buf, len);
+    if (r == 0) {
+        phase_end("read HUB");
+        r = write_dump(fname, address, buf, len);
     }
+    if (r == 0 && verbose) printf("Saved %d bytes of HUB at %08x to %s\n", len, address, fname);
+    free(buf);
+    return r;
+}
 
-    // we want to be able to insert 0 characters in fname
-    // in order to break up multiple file names into different strings
-    // so we have to copy it to a duplicate buffer
-    fname = duplicate_string(fname);
-    
-    do {
-        fname = getNextFile(fname, &next_fname, &address);
-        if (!next_fname) break; /* no more files */
+#define PROP_CHK "> Prop_Chk 0 0 0 0  "
+#define PROP_VER "\r\nProp_Ver "
+#define PROP_VER_LEN 11
 
-        if (*next_fname == '+') {
-            next_fname++;
-            send_size = 1;
-        } else {
-            send_size = 0;
-        }
-        size = readBinaryFile(next_fname);
-        if (size < 0)
-        {
-            printf("Could not open %s\n", next_fname);
-            return 1;
-        }
+// time to allow for a Prop_Chk reply before asking again
+#define PROBE_PERIOD(baud) (60+20*10*1000/(baud))
 
-        /* OK, now send the address and file size */
-        if (verbose) printf("Sending header\n");
-        tx_raw_long(address);
-        if (send_size) {
-            int effective_size = size + 4;
-            // prefix the file data with 4 bytes of size
-            tx_raw_long(effective_size);
-            address += effective_size;
-            tx_raw_long(size);
-            // initialize the checksum to the data we just sent
-            chksum = size & 0xff;
-            chksum += (size>>8) & 0xff;
-            chksum += (size>>16) & 0xff;
-            chksum += (size>>24) & 0xff;
-        } else {
-            tx_raw_long(size);
-            address += size;
-            chksum = 0;
-        }
+// silicon version letter and port of the last P2 found
+static char p2_version;
+static char p2_port[256];
 
-        if (verbose) printf("Loading %s - %d bytes\n", next_fname, size);
-        while ((num=loadBytes(buffer, 1024)))
+// note the version of a P2 we found, and pick a load mode to suit it
+static void p2_found(const char *Port, char version)
+{
+    p2_version = version;
+    strncpy(p2_port, Port, sizeof(p2_port)-1);
+    if (verbose) printf("P2 version %c found on serial port %s\n", version, Port);
+    if (load_mode == -1)
+    {
+        if (version == 'B')
         {
-            int i;
-            if (patch)
-            {
-                patch = 0;
-                memcpy(&buffer[0x14], &clock_freq, 4);
-                memcpy(&buffer[0x18], &clock_mode, 4);
-                memcpy(&buffer[0x1c], &user_baud, 4);
-            }
-            tx((uint8_t *)buffer, num);
-            totnum += num;
-            for (i = 0; i < num; i++) {
-                chksum += buffer[i];
-            }
-        }
-        // receive checksum, verify it
-        int recv_chksum = 0;
-        wait_drain();
-        msleep(1+fifo_size*10*1000/loader_baud);
-        num = rx_timeout((uint8_t *)buffer, 3, 400);
-        if (num != 3) {
-            printf("ERROR: timeout waiting for checksum at end: got %d\n", num);
-            printf("Try increasing the FIFO setting if not large enough for your setup\n");
-            return 1;
+            load_mode = LOAD_FPGA;
+            if (verbose) printf("Setting load mode to FPGA\n");
         }
-        recv_chksum = (buffer[0] - '@') << 4;
-        recv_chksum += (buffer[1] - '@');
-        chksum &= 0xff;
-        if (recv_chksum != (chksum & 0xff)) {
-            printf("ERROR: bad checksum, expected %02x got %02x (chksum characters %c%c%c)\n", chksum, recv_chksum, buffer[0], buffer[1], buffer[2]);
-            promptexit(1);
+        else if (version == 'A' || version == 'G')
+        {
+            load_mode = LOAD_CHIP;
+            if (verbose) printf("Setting load mode to CHIP\n");
         }
-        if (verbose) printf("chksum: %x OK\n", recv_chksum);
-        if (*fname) {
-            // more files to send
-            tx_raw_byte('+');
-        } else {
-            tx_raw_byte('-');
+        else
+        {
+            printf("Warning: Unknown version %c, assuming CHIP\n", version);
+            load_mode = LOAD_CHIP;
         }
-    } while (*fname);
-    msleep(100);
-    return 0;
+    }
 }
 
 // check for a p2 on a specific port
@@ -673,36 +2415,14 @@ checkp2_and_init(char *Port, int baudrate, int retries)
 
     for (i = 0; i < retries; i++) {
         flush_input();
-        tx((uint8_t *)"> Prop_Chk 0 0 0 0  ", 20);
+        tx((uint8_t *)PROP_CHK, strlen(PROP_CHK));
         wait_drain();
-        msleep(50+20*10*1000/loader_baud); // wait at least for 20 chars to empty through any fifo at the loader baud rate 
-        num = rx_timeout((uint8_t *)buffer, 20, 10+20*10*1000/loader_baud); // read 20 characters 
-        if (num >= 0) buffer[num] = 0;
-        else {
-            buffer[0] = 0;
-            if (0 && verbose) printf("  timeout\n");
-        }
-        if (!strncmp(buffer, "\r\nProp_Ver ", 11))
+        // the reply is "\r\nProp_Ver X\r\n"; stop as soon as it is in
+        num = rx_wait((uint8_t *)buffer, 14, PROBE_PERIOD(loader_baud));
+        buffer[num] = 0;
+        if (!strncmp(buffer, PROP_VER, PROP_VER_LEN))
         {
-            if (verbose) printf("P2 version %c found on serial port %s\n", buffer[11], Port);
-            if (load_mode == -1)
-            {
-                if (buffer[11] == 'B')
-                {
-                    load_mode = LOAD_FPGA;
-                    if (verbose) printf("Setting load mode to FPGA\n");
-                }
-                else if (buffer[11] == 'A' || buffer[11] == 'G')
-                {
-                    load_mode = LOAD_CHIP;
-                    if (verbose) printf("Setting load mode to CHIP\n");
-                }
-                else
-                {
-                    printf("Warning: Unknown version %c, assuming CHIP\n", buffer[11]);
-                    load_mode = LOAD_CHIP;
-                }
-            }
+            p2_found(Port, buffer[PROP_VER_LEN]);
             return 1;
         }
     }
@@ -711,13 +2431,58 @@ checkp2_and_init(char *Port, int baudrate, int retries)
     return 0;
 }
     
+// report how close the port came to the requested loader baud rate;
+// non-standard rates are passed straight to the driver, which picks
+// the nearest divisor it can manage
+static void check_loader_baud(void)
+{
+    unsigned long actual = serial_actual_baud();
+    double err;
+
+    if (!actual) {
+        return;
+    }
+    err = 100.0 * ((double)actual - (double)loader_baud) / (double)loader_baud;
+    if (verbose || err >= 1.0 || err <= -1.0) {
+        printf("Loader baud %d: actual rate %lu (%+.2f%% error)\n", loader_baud, actual, err);
+    }
+}
+
+// with -v, show how many write() calls it took to send everything so far
+static void report_tx_stats(const char *what)
+{
+    unsigned long bytes, calls;
+
+    if (!verbose) {
+        return;
+    }
+    tx_flush();
+    tx_stats(&bytes, &calls);
+    printf("%s: sent %lu bytes in %lu writes (%.4f writes/byte)\n", what,
+           bytes, calls, bytes ? (double)calls / (double)bytes : 0.0);
+}
+
+// with -v, show how close the receive ring came to filling up
+static void report_rx_stats(void)
+{
+    unsigned long high_water, overruns;
+
+    if (!verbose) {
+        return;
+    }
+    rx_stats(&high_water, &overruns);
+    printf("receive: at most %lu bytes waiting, %lu bytes lost\n", high_water, overruns);
+}
+
+#ifdef INTEGER_PREFIXES
 // look for a p2
-int findp2(char *portprefix, int baudrate)
+// with list set, report every P2 found rather than stopping at the first
+int findp2(char *portprefix, int baudrate, int list)
 {
     char Port[1024];
-#ifdef INTEGER_PREFIXES    
     int i;
     char targetPath[1024];
+    int found = 0;
     
     if (verbose) printf("Searching serial ports for a P2\n");
     for (i = 1; i < 255; i++)
@@ -727,13 +2492,37 @@ int findp2(char *portprefix, int baudrate)
             continue;
         if (checkp2_and_init(Port, baudrate, 50))
         {
-            return 1;
+            if (!list) {
+                return 1;
+            }
+            printf("%s: P2 version %c\n", Port, p2_version);
+            serial_done();
+            found++;
         }
     }
+    return found;
+}
 #else
+static int port_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// look for a p2
+// all the candidate ports are reset and probed at the same time, so
+// the search takes as long as one port rather than one per adapter
+// with list set, report every P2 found rather than stopping at the first
+int findp2(char *portprefix, int baudrate, int list)
+{
     DIR *dir;
     struct dirent *entry;
     size_t prefixlen = strlen(portprefix);
+    char **ports = NULL;
+    char *version;
+    int nports = 0;
+    int maxports = 0;
+    int found = 0;
+    int i;
 
     dir = opendir("/dev");
     if (!dir) {
@@ -746,17 +2535,65 @@ int findp2(char *portprefix, int baudrate)
         if (0 != strncmp(entry->d_name, portprefix, prefixlen)) {
             continue;
         }
-        strcpy(Port, "/dev/");
-        strcat(Port, entry->d_name);
-        if (checkp2_and_init(Port, baudrate, 60)) {
-            closedir(dir);
-            return 1;
+        if (nports == maxports) {
+            maxports = maxports ? 2*maxports : 16;
+            ports = realloc(ports, maxports * sizeof(*ports));
+            if (!ports) {
+                printf("Out of memory\n");
+                promptexit(1);
+            }
         }
+        ports[nports] = malloc(strlen(entry->d_name) + 6);
+        if (!ports[nports]) {
+            printf("Out of memory\n");
+            promptexit(1);
+        }
+        strcpy(ports[nports], "/dev/");
+        strcat(ports[nports], entry->d_name);
+        nports++;
     }
     closedir(dir);
-#endif
-    return 0;
+    if (nports == 0) {
+        return 0;
+    }
+    qsort(ports, nports, sizeof(*ports), port_cmp);
+
+    if (!do_hwreset) {
+        // nothing to probe with; take the first port that opens
+        for (i = 0; i < nports && !found; i++) {
+            found = checkp2_and_init(ports[i], baudrate, 0);
+        }
+    } else {
+        version = malloc(nports);
+        if (!version) {
+            printf("Out of memory\n");
+            promptexit(1);
+        }
+        if (verbose) {
+            for (i = 0; i < nports; i++) printf("trying %s...\n", ports[i]);
+        }
+        i = serial_probe(ports, nports, baudrate, PROP_CHK, PROP_VER, version,
+                         !list, PROBE_PERIOD(baudrate), 60*PROBE_PERIOD(baudrate));
+        if (list) {
+            for (i = 0; i < nports; i++) {
+                if (version[i]) {
+                    printf("%s: P2 version %c\n", ports[i], version[i]);
+                    found++;
+                }
+            }
+        } else if (i >= 0) {
+            p2_found(ports[i], version[i]);
+            found = 1;
+        }
+        free(version);
+    }
+    for (i = 0; i < nports; i++) {
+        free(ports[i]);
+    }
+    free(ports);
+    return found;
 }
+#endif
 
 int atox(char *ptr)
 {
@@ -793,6 +2630,106 @@ int get_clock_mode(int sysfreq)
     return setfreq;
 }
 
+/*
+ * read every file in a filespec into memory ahead of time
+ * returns 0 on success, 1 if any of them could not be read
+ */
+static int preload_files(char *fname)
+{
+    char *next_fname = NULL;
+    int address = 0;
+
+    if (load_mode == LOAD_SINGLE || load_mode == LOAD_FPGA) {
+        return readBinaryFile(fname) < 0;
+    }
+    fname = duplicate_string(fname);
+    if (!fname) {
+        return 1;
+    }
+    while ((fname = getNextFile(fname, &next_fname, &address)) != NULL) {
+        if (*next_fname == '+') {
+            next_fname++;
+        }
+        if (readBinaryFile(next_fname) < 0) {
+            printf("Could not open %s\n", next_fname);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#ifdef HAVE_FORK
+/*
+ * load the same files onto several boards at once
+ * the files are read once, here, and then a child process is forked
+ * for each port. Each child returns the port it should use and carries
+ * on with an ordinary load, with its own handshake; the parent never
+ * returns, but waits for them all and prints a table of the results
+ */
+static char *broadcast(char **ports, int nports, char *fname)
+{
+    pid_t *pids = calloc(nports, sizeof(*pids));
+    int *status = calloc(nports, sizeof(*status));
+    unsigned long long *ms = calloc(nports, sizeof(*ms));
+    unsigned long long start;
+    int running = 0;
+    int failed = 0;
+    int i, st;
+    pid_t pid;
+
+    if (!pids || !status || !ms) {
+        printf("Out of memory\n");
+        promptexit(1);
+    }
+    if (preload_files(fname)) {
+        promptexit(1);
+    }
+    fflush(stdout);
+    start = elapsedms();
+    for (i = 0; i < nports; i++) {
+        pid = fork();
+        if (pid == 0) {
+            // the cache is for finding a single board, and the children
+            // would only trip over each other updating it
+            use_port_cache = 0;
+            waitAtExit = 0;
+            setvbuf(stdout, NULL, _IOLBF, 0);
+            return ports[i];
+        }
+        if (pid < 0) {
+            perror("fork");
+            status[i] = -1;
+        } else {
+            running++;
+        }
+        pids[i] = pid;
+    }
+
+    while (running > 0) {
+        pid = wait(&st);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (i = 0; i < nports; i++) {
+            if (pids[i] != pid) continue;
+            ms[i] = elapsedms() - start;
+            status[i] = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+            running--;
+        }
+    }
+
+    printf("\n%-32s %-6s %8s\n", "port", "result", "time");
+    for (i = 0; i < nports; i++) {
+        if (status[i] != 0) failed++;
+        printf("%-32s %-6s %5llu ms\n", ports[i], status[i] ? "FAIL" : "ok", ms[i]);
+    }
+    printf("%d of %d boards loaded\n", nports - failed, nports);
+    promptexit(failed ? 1 : 0);
+    return NULL;
+}
+#endif
+
 int main(int argc, char **argv)
 {
     int i;
@@ -800,8 +2737,16 @@ int main(int argc, char **argv)
     int pstmode = 0;
     char *fname = 0;
     char *port = 0;
+    char *ports[MAX_PORTS];
+    int nports = 0;
+    int port_ok = 0;
+    PortCacheEntry cached;
+    int default_baud, default_fifo, default_mode, default_clock;
+    int r;
     int address = 0;
     char *u9root = 0;
+    char *telemetry = 0;
+    int use_channels = 0;
     
     // Parse the command-line parameters
     for (i = 1; i < argc; i++)
@@ -817,6 +2762,10 @@ int main(int argc, char **argv)
                 else {
                     Usage("Missing parameter for -p");
                 }
+                if (nports == MAX_PORTS) {
+                    Usage("Too many -p ports");
+                }
+                ports[nports++] = port;
             }
             else if (argv[i][1] == 'b')
             {
@@ -830,12 +2779,74 @@ int main(int argc, char **argv)
             }
             else if (argv[i][1] == 'l')
             {
+                char *arg = NULL;
+
                 if(argv[i][2])
-                    loader_baud = atoi(&argv[i][2]);
+                    arg = &argv[i][2];
                 else if (++i < argc)
-                    loader_baud = atoi(argv[i]);
+                    arg = argv[i];
                 else 
                     Usage("Missing parameter for -l");
+                loader_baud_auto = 0;
+                if (!strcmp(arg, "max"))
+                    loader_baud = LOADER_MAX_BAUD;
+                else if (!strcmp(arg, "auto"))
+                    loader_baud_auto = 1;
+                else
+                    loader_baud = atoi(arg);
+                loader_baud_set = 1;
+            }
+            else if (!strcmp(argv[i], "-XMEM"))
+            {
+                char *p;
+
+                if (++i >= argc) {
+                    Usage("Missing parameter for -XMEM");
+                }
+                xmem_mailbox = strtoul(argv[i], &p, 16);
+                xmem_command = XMEM_WRITE;
+                if (*p != ',' || !p[1] || (xmem_mailbox & 3)
+                    || xmem_mailbox > HUB_SIZE - 12
+                    || (xmem_mailbox + 12 > XMEM_DRIVER && xmem_mailbox < XMEM_BUFFER + 2*XMEM_BLOCK)) {
+                    Usage("-XMEM needs mbox,driver with mbox a long aligned HUB address in hex, outside $30000-$5FFFF");
+                }
+                xmem_driver = p + 1;
+                p = strchr(xmem_driver, ',');
+                if (p) {
+                    *p++ = 0;
+                    xmem_command = strtoul(p, &p, 16);
+                    if (*p || !(xmem_command & 0x80000000) || (xmem_command & XMEM_ADDR_MASK)) {
+                        Usage("-XMEM command must be in hex, with bit 31 set and the address bits clear");
+                    }
+                }
+            }
+            else if (!strcmp(argv[i], "-XLOAD"))
+            {
+                char *p;
+
+                if (++i >= argc) {
+                    Usage("Missing parameter for -XLOAD");
+                }
+                if (nxloads == MAX_XLOADS) {
+                    Usage("Too many -XLOAD files");
+                }
+                xloads[nxloads].address = strtoul(argv[i], &p, 16);
+                if (*p != ',' || !p[1] || xloads[nxloads].address > XMEM_ADDR_MASK) {
+                    Usage("-XLOAD needs addr,file with addr in hex");
+                }
+                xloads[nxloads++].fname = p + 1;
+            }
+            else if (!strcmp(argv[i], "-TELEMETRY"))
+            {
+                if (++i >= argc) {
+                    Usage("Missing parameter for -TELEMETRY");
+                }
+                telemetry = argv[i];
+                use_channels = 1;
+            }
+            else if (!strcmp(argv[i], "-CHANNELS"))
+            {
+                use_channels = 1;
             }
             else if (argv[i][1] == 'X')
             {
@@ -870,6 +2881,7 @@ int main(int argc, char **argv)
                     fifo_size = atoi(argv[i]);
                 else
                     Usage("Missing byte count for -FIFO");
+                fifo_size_set = 1;
             }
             else if (argv[i][1] == 'k')
             {
@@ -949,6 +2961,39 @@ int main(int argc, char **argv)
                 load_mode = LOAD_FPGA;
             else if (!strcmp(argv[i], "-SINGLE"))
                 load_mode = LOAD_SINGLE;
+            else if (!strcmp(argv[i], "-HEX"))
+                use_base64 = 0;
+            else if (!strcmp(argv[i], "-LIST"))
+                list_ports = 1;
+            else if (!strcmp(argv[i], "-COMPRESS"))
+                use_compression = 1;
+            else if (!strcmp(argv[i], "-DELTA"))
+                use_delta = 1;
+            else if (!strcmp(argv[i], "-FRAMED"))
+                use_framing = 1;
+            else if (!strcmp(argv[i], "-PIPELINE"))
+                use_pipeline = 1;
+            else if (!strcmp(argv[i], "-VERIFY"))
+                use_verify = 1;
+            else if (!strcmp(argv[i], "-DUMP"))
+            {
+                char *p;
+
+                if (++i >= argc) {
+                    Usage("Missing parameter for -DUMP");
+                }
+                dump_address = strtoul(argv[i], &p, 16);
+                if (*p == ',') {
+                    dump_len = strtoul(p + 1, &p, 16);
+                }
+                if (*p != ',' || !p[1] || dump_len <= 0 || dump_address >= HUB_SIZE
+                    || dump_len > HUB_SIZE - dump_address) {
+                    Usage("-DUMP needs addr,len,file with addr and len in hex, within HUB");
+                }
+                dump_file = p + 1;
+            }
+            else if (!strcmp(argv[i], "-NOCACHE"))
+                use_port_cache = 0;
             else if (!strcmp(argv[i], "-NOZERO"))
                 force_zero = 0;
             else if (!strcmp(argv[i], "-ZERO"))
@@ -976,9 +3021,37 @@ int main(int argc, char **argv)
             Usage(NULL);
         }
     }
-    if (!fname && !runterm && !enter_rom) {
+    if (list_ports) {
+        if (!findp2(PORT_PREFIX, loader_baud, 1)) {
+            printf("Could not find a P2\n");
+            promptexit(1);
+        }
+        promptexit(0);
+    }
+    if (dump_file && (fname || enter_rom || nports > 1)) {
+        Usage("-DUMP cannot be combined with loading a file");
+    }
+    if (!xmem_driver != !nxloads) {
+        Usage("-XMEM and -XLOAD must be used together");
+    }
+    if (nxloads && !fname) {
+        Usage("-XLOAD needs a program to load into HUB as well");
+    }
+    if (!fname && !runterm && !enter_rom && !dump_file) {
         Usage("Must specify a file name or -t or -x");
     }
+    if (nports > 1) {
+        if (!fname || runterm || enter_rom || send_script || u9root || use_channels) {
+            Usage("Several -p ports may only be used to load a file");
+        }
+#ifdef HAVE_FORK
+        // from here on we are one of the children, loading one board
+        port = broadcast(ports, nports, fname);
+#else
+        printf("Loading several boards at once is not supported on this platform\n");
+        promptexit(1);
+#endif
+    }
     // Determine the user baud rate
     if (user_baud == -1)
     {
@@ -1002,15 +3075,53 @@ int main(int argc, char **argv)
     }
     
     // Determine the P2 serial port
+    phase_begin();
+    default_baud = loader_baud;
+    default_fifo = fifo_size;
+    default_mode = load_mode;
+    default_clock = clock_mode;
+    if (!port && use_port_cache && do_hwreset && portcache_find(PORT_PREFIX, &cached))
+    {
+        int chip = load_mode == LOAD_CHIP ||
+            (load_mode == -1 && (cached.version == 'A' || cached.version == 'G'));
+
+        // go straight to the adapter that worked last time
+        if (fname && !loader_baud_set && cached.loader_baud > 0) {
+            loader_baud = cached.loader_baud;
+        }
+        if (!fifo_size_set && cached.fifo_size > 0) {
+            fifo_size = cached.fifo_size;
+        }
+        if (verbose) printf("Trying cached port %s (P2 version %c)\n", cached.port, cached.version);
+        if (fname && !dump_file && chip && serial_init(cached.port, loader_baud)) {
+            // the loader handshake will tell us soon enough whether
+            // the P2 is still there, so don't ask it first
+            hwreset();
+            msleep(20);
+            p2_found(cached.port, cached.version);
+            port = cached.port;
+            port_ok = 1;
+            cache_unverified = 1;
+            cached_loader_baud = cached.auto_baud;
+        } else if (checkp2_and_init(cached.port, loader_baud, 10)) {
+            port = cached.port;
+            port_ok = 1;
+            cached_loader_baud = cached.auto_baud;
+        } else {
+            if (verbose) printf("No P2 on cached port %s, searching\n", cached.port);
+            loader_baud = default_baud;
+            fifo_size = default_fifo;
+        }
+    }
     if (!port)
     {
-        if (!findp2(PORT_PREFIX, loader_baud))
+        if (!findp2(PORT_PREFIX, loader_baud, 0))
         {
             printf("Could not find a P2\n");
             promptexit(1);
         }
     }
-    else
+    else if (!port_ok)
     {
         if (!checkp2_and_init(port, loader_baud, 100))
         {
@@ -1018,46 +3129,81 @@ int main(int argc, char **argv)
             promptexit(1);
         }
     }
-    if (fname)
-    {
-        if (load_mode == LOAD_CHIP)
+    phase_end("reset and probe");
+    if (fname || dump_file) {
+        check_loader_baud();
+    }
+    if (dump_file) {
+        if (dumpfile(dump_address, dump_len, dump_file))
         {
-            if (clock_mode == -1)
-            {
-                clock_mode = get_clock_mode(clock_freq);
-                if (verbose) printf("Setting clock_mode to %x\n", clock_mode);
-            }
+            serial_done();
+            promptexit(1);
         }
-        else if (load_mode == LOAD_FPGA)
+        report_tx_stats("dump");
+    }
+    if (fname)
+    {
+        set_clock_mode();
+        r = loadfile(fname, address);
+        if (r == LOADFILE_RETRY)
         {
-            int temp = clock_freq / 312500; // * 256 / 80000000
-            int temp1 = temp - 1;
-            if (clock_mode == -1)
+            // the cached port was wrong after all; look for the P2
+            if (verbose) printf("No P2 on cached port %s, searching\n", cached.port);
+            serial_done();
+            cache_unverified = 0;
+            cached_loader_baud = 0;
+            loader_baud = default_baud;
+            fifo_size = default_fifo;
+            load_mode = default_mode;
+            clock_mode = default_clock;
+            phase_begin();
+            if (!findp2(PORT_PREFIX, loader_baud, 0))
             {
-                clock_mode = temp1;
-                if (verbose) printf("Setting clock_mode to %x\n", temp1);
+                printf("Could not find a P2\n");
+                promptexit(1);
             }
+            phase_end("reset and probe");
+            check_loader_baud();
+            set_clock_mode();
+            r = loadfile(fname, address);
         }
-        else if (load_mode == -1)
-        {
-            load_mode = LOAD_SINGLE;
-            if (verbose) printf("Setting load mode to SINGLE\n");
-        }
-
-        if (loadfile(fname, address))
+        if (r)
         {
             serial_done();
             promptexit(1);
         }
+        report_tx_stats("load");
+    }
+    if (use_port_cache && p2_version) {
+        // a rate -l auto climbed to is only good once the loader is running
+        if (loader_baud_auto) {
+            portcache_update(p2_port, p2_version, fifo_size, 0, fname ? loader_baud : 0);
+        } else {
+            portcache_update(p2_port, p2_version, fifo_size, fname ? loader_baud : 0, 0);
+        }
     }
 
     if (u9root) {
         runterm = 3;
         u9fs_init(u9root);
     }
+    if (telemetry && !telemetry_open(telemetry)) {
+        promptexit(1);
+    }
+    if (use_channels) {
+        // channel frames are only looked for when asked for, as other
+        // programs may well print 0xFF 0x02
+        runterm |= 5;
+    }
     if (runterm || enter_rom || send_script)
     {
-        serial_baud(user_baud);
+        if (!serial_baud(user_baud)) {
+            promptexit(1);
+        }
+        // from here on the program's output is drained by a thread of
+        // its own, so none is lost while a script waits or a 9P request
+        // is being served
+        serial_start_io();
         switch(enter_rom) {
         case ENTER_DEBUG:
             tx((uint8_t *)"> \004", 3);
@@ -1070,6 +3216,7 @@ int main(int argc, char **argv)
         }
         if (send_script) {
             RunScript(send_script);
+            report_tx_stats("script");
         }
         if (runterm) {
             if (!quiet_mode) {
@@ -1080,6 +3227,7 @@ int main(int argc, char **argv)
                 waitAtExit = 0; // no need to wait, user explicitly quit
             }
         }
+        report_rx_stats();
     }
 
     serial_done();
@@ -1152,7 +3300,7 @@ static int SendFile(char *filename, int binary)
             tx_raw_byte(c);
         }
         count++;
-        if (count >= scriptVarPauseAfter) {
+        if (scriptVarPauseAfter && count >= scriptVarPauseAfter) {
             // pause periodically for the other end to keep up
             msleep(1);
             count = 0;
@@ -1174,6 +3322,71 @@ scriptBinfile(char *name)
     return SendFile(name, 1);
 }
 
+#ifdef HAVE_REACTOR
+typedef struct script_recv {
+    Reactor *reactor;
+    char *string;
+    char *here;
+    int found;
+} ScriptRecv;
+
+/* input from the port: match as much of it as has arrived */
+static void scriptRecvInput(void *arg)
+{
+    ScriptRecv *sr = (ScriptRecv *)arg;
+    int num, i;
+
+    // never read past the end of the string, so nothing after it is lost
+    num = rx_timeout((uint8_t *)buffer, strlen(sr->here), 0);
+    for (i = 0; i < num; i++) {
+        if (buffer[i] != *sr->here) {
+            // reset our expectations
+            sr->here = sr->string;
+            continue;
+        }
+        sr->here++;
+    }
+    if (!*sr->here) {
+        sr->found = 1;
+        reactor_stop(sr->reactor);
+    }
+}
+
+static void scriptRecvTimeout(void *arg)
+{
+    ScriptRecv *sr = (ScriptRecv *)arg;
+
+    printf("ERROR: timeout waiting for string [%s]\n", sr->string);
+    reactor_stop(sr->reactor);
+}
+
+static int scriptRecv(char *string)
+{
+    ScriptRecv sr;
+
+    if (!*string) {
+        return 1;
+    }
+    // anything sent has to go out before the reply can come back
+    tx_flush();
+    sr.string = sr.here = string;
+    sr.found = 0;
+    sr.reactor = reactor_new();
+    if (!sr.reactor
+        || reactor_watch(sr.reactor, serial_input_fd(), scriptRecvInput, &sr) != 0
+        || (scriptVarRecvTimeout
+            && reactor_timer(sr.reactor, scriptVarRecvTimeout, 0, scriptRecvTimeout, &sr) < 0))
+    {
+        printf("ERROR: unable to wait for input\n");
+    } else {
+        reactor_run(sr.reactor);
+    }
+    if (sr.reactor) {
+        reactor_free(sr.reactor);
+    }
+    return sr.found;
+}
+#else
 static int scriptRecv(char *string)
 {
     int num;
@@ -1203,6 +3416,7 @@ static int scriptRecv(char *string)
     }
     return 1;
 }
+#endif
 
 static int scriptSend(char *string)
 {
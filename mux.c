@@ -0,0 +1,241 @@
+/*
+ * mux.c - several channels over the one serial port
+ *
+ * The demultiplexer finds the frames and hands their data over in
+ * whatever pieces it arrives in; this keeps the credit accounts,
+ * queues what the P2 has no room for yet, and puts 9P messages back
+ * together before they are delivered.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "demux.h"
+#include "mux.h"
+
+int mux_init(Mux *m, int maxmsg, const MuxOps *ops, void *arg)
+{
+    memset(m, 0, sizeof(*m));
+    m->ops = ops;
+    m->arg = arg;
+    m->msg = malloc(maxmsg);
+    if (!m->msg) {
+        return -1;
+    }
+    m->maxmsg = maxmsg;
+    return 0;
+}
+
+void mux_free(Mux *m)
+{
+    int i;
+
+    for (i = 0; i < MUX_CHANNELS; i++) {
+        free(m->chan[i].queue);
+        m->chan[i].queue = NULL;
+    }
+    free(m->msg);
+    m->msg = NULL;
+}
+
+static void send_frame(Mux *m, int chan, const uint8_t *data, int len)
+{
+    uint8_t hdr[MUX_HEADER];
+
+    hdr[0] = DEMUX_ESC;
+    hdr[1] = MUX_FRAME;
+    hdr[2] = chan;
+    hdr[3] = len & 0xff;
+    hdr[4] = (len >> 8) & 0xff;
+    m->ops->send(m->arg, hdr, MUX_HEADER);
+    m->ops->send(m->arg, data, len);
+}
+
+static void send_credit(Mux *m, int chan, int n)
+{
+    uint8_t msg[4];
+
+    msg[0] = MUX_CREDIT;
+    msg[1] = chan;
+    msg[2] = n & 0xff;
+    msg[3] = (n >> 8) & 0xff;
+    send_frame(m, MUX_CONTROL, msg, 4);
+}
+
+/* send up to len bytes as the P2's credit allows; returns the count sent */
+static int send_data(Mux *m, int chan, const uint8_t *data, int len)
+{
+    MuxChan *c = &m->chan[chan];
+    int sent = 0;
+    int n;
+
+    while (sent < len && c->credit > 0) {
+        n = len - sent;
+        if (n > c->credit) n = c->credit;
+        if (n > MUX_MAXDATA) n = MUX_MAXDATA;
+        send_frame(m, chan, data + sent, n);
+        c->credit -= n;
+        sent += n;
+    }
+    return sent;
+}
+
+/* send whatever is waiting on chan that there is now credit for */
+static void pump(Mux *m, int chan)
+{
+    MuxChan *c = &m->chan[chan];
+    int n = send_data(m, chan, c->queue, c->queued);
+
+    if (n > 0) {
+        c->queued -= n;
+        memmove(c->queue, c->queue + n, c->queued);
+    }
+}
+
+/* the P2 has switched to frames: start every channel afresh */
+static void start(Mux *m)
+{
+    int i;
+
+    m->active = 1;
+    m->have = 0;
+    for (i = 0; i < MUX_CHANNELS; i++) {
+        m->chan[i].credit = 0;
+        m->chan[i].consumed = 0;
+        m->chan[i].queued = 0;
+    }
+    for (i = MUX_CONTROL + 1; i < MUX_CHANNELS; i++) {
+        send_credit(m, i, MUX_WINDOW);
+    }
+    if (m->ops->started) {
+        m->ops->started(m->arg);
+    }
+}
+
+static void control(Mux *m, int c)
+{
+    int chan;
+
+    m->ctl[m->nctl++] = c;
+    switch (m->ctl[0]) {
+    case MUX_HELLO:
+        if (m->nctl < 2) return;
+        start(m);
+        break;
+    case MUX_CREDIT:
+        if (m->nctl < 4) return;
+        chan = m->ctl[1];
+        if (chan > MUX_CONTROL && chan < MUX_CHANNELS) {
+            m->chan[chan].credit += m->ctl[2] | (m->ctl[3] << 8);
+            pump(m, chan);
+        }
+        break;
+    default:
+        // not one we know; skip it
+        break;
+    }
+    m->nctl = 0;
+}
+
+static int msg_size(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static int msg_ok(Mux *m, unsigned size)
+{
+    return size >= DEMUX_MINFRAME && size <= (unsigned)m->maxmsg;
+}
+
+/* put 9P messages back together from the channel's data */
+static void add_message(Mux *m, const uint8_t *data, int len)
+{
+    int want, n;
+
+    while (len > 0) {
+        if (m->have == 0 && len >= 4) {
+            n = msg_size(data);
+            if (msg_ok(m, n) && len >= n) {
+                // all here; no need to copy it
+                m->ops->deliver(m->arg, MUX_9P, data, n);
+                data += n;
+                len -= n;
+                continue;
+            }
+        }
+        want = m->have < 4 ? 4 : m->need;
+        n = want - m->have;
+        if (n > len) n = len;
+        memcpy(m->msg + m->have, data, n);
+        m->have += n;
+        data += n;
+        len -= n;
+        if (m->have == 4) {
+            m->need = msg_size(m->msg);
+            if (!msg_ok(m, m->need)) {
+                // out of step; all we can do is start again
+                m->have = 0;
+                continue;
+            }
+        }
+        if (m->have > 4 && m->have == m->need) {
+            m->have = 0;
+            m->ops->deliver(m->arg, MUX_9P, m->msg, m->need);
+        }
+    }
+}
+
+void mux_input(Mux *m, int chan, const uint8_t *data, int len)
+{
+    MuxChan *c = &m->chan[chan];
+    int i;
+
+    if (chan == MUX_CONTROL) {
+        for (i = 0; i < len; i++) {
+            control(m, data[i]);
+        }
+        return;
+    }
+    if (chan == MUX_9P) {
+        add_message(m, data, len);
+    } else {
+        m->ops->deliver(m->arg, chan, data, len);
+    }
+    // it has all been dealt with, so the P2 may send as much again
+    c->consumed += len;
+    if (m->active && c->consumed >= MUX_WINDOW / 2) {
+        send_credit(m, chan, c->consumed);
+        c->consumed = 0;
+    }
+}
+
+int mux_write(Mux *m, int chan, const uint8_t *data, int len)
+{
+    MuxChan *c = &m->chan[chan];
+    uint8_t *q;
+    int size, n;
+
+    if (c->queued == 0) {
+        n = send_data(m, chan, data, len);
+        data += n;
+        len -= n;
+    }
+    if (len == 0) {
+        return 1;
+    }
+    if (c->queued + len > c->queue_size) {
+        size = c->queue_size ? c->queue_size : 256;
+        while (size < c->queued + len) {
+            size *= 2;
+        }
+        q = realloc(c->queue, size);
+        if (!q) {
+            return 0;
+        }
+        c->queue = q;
+        c->queue_size = size;
+    }
+    memcpy(c->queue + c->queued, data, len);
+    c->queued += len;
+    return 1;
+}
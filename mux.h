@@ -0,0 +1,93 @@
+/*
+ * mux.h - several channels over the one serial port
+ *
+ * A program on the P2 that wants more than a console can send frames
+ *
+ *     0xFF 0x02 chan len_lo len_hi data...
+ *
+ * carrying up to MUX_MAXDATA bytes for one channel. Once it sends
+ * MUX_HELLO on the control channel, everything the host sends back is
+ * framed the same way. Neither side sends more on a channel than the
+ * other has given it credit for, so a slow consumer on one channel
+ * holds up only that channel.
+ *
+ * testfile/mux.h has the P2 side of this; the two must match.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __MUX_H__
+#define __MUX_H__
+
+#include <stdint.h>
+
+/* second byte of a frame, after DEMUX_ESC */
+#define MUX_FRAME 0x02
+/* DEMUX_ESC, MUX_FRAME, channel, and 2 bytes of length */
+#define MUX_HEADER 5
+/* most data in one frame */
+#define MUX_MAXDATA 1024
+
+/* channels */
+#define MUX_CONTROL   0     /* the messages below; needs no credit */
+#define MUX_CONSOLE   1     /* text for the terminal, and keys back */
+#define MUX_9P        2     /* file server requests, and replies back */
+#define MUX_TELEMETRY 3     /* anything else the program wants saved */
+#define MUX_CHANNELS  4
+
+/* control messages */
+#define MUX_HELLO  1        /* MUX_HELLO version: frame everything from now on */
+#define MUX_CREDIT 2        /* MUX_CREDIT chan n_lo n_hi: n more bytes may be sent on chan */
+#define MUX_VERSION 1
+
+/* credit the host gives the P2 on each channel */
+#define MUX_WINDOW 4096
+
+typedef struct mux_ops {
+    /* send bytes to the P2 as they are */
+    void (*send)(void *arg, const uint8_t *data, int len);
+    /* data from the P2; MUX_9P only ever gets whole messages */
+    void (*deliver)(void *arg, int chan, const uint8_t *data, int len);
+    /* the P2 has said hello */
+    void (*started)(void *arg);
+} MuxOps;
+
+typedef struct mux_chan {
+    int credit;         /* bytes the P2 will still take */
+    int consumed;       /* bytes taken from the P2 since it was last told */
+    uint8_t *queue;     /* waiting for credit */
+    int queued;
+    int queue_size;
+} MuxChan;
+
+typedef struct mux {
+    const MuxOps *ops;
+    void *arg;
+    int active;         /* the P2 has said hello */
+    MuxChan chan[MUX_CHANNELS];
+    uint8_t ctl[4];     /* a control message in pieces */
+    int nctl;
+    uint8_t *msg;       /* a 9P message in pieces */
+    int maxmsg;
+    int have;
+    int need;
+} Mux;
+
+/*
+ * set up m to pass what arrives to ops; 9P messages may be up to
+ * maxmsg bytes long
+ * returns 0 on success, -1 if out of memory
+ */
+int mux_init(Mux *m, int maxmsg, const MuxOps *ops, void *arg);
+void mux_free(Mux *m);
+
+/* handle data that arrived on a channel, in pieces of any size */
+void mux_input(Mux *m, int chan, const uint8_t *data, int len);
+
+/*
+ * send data to the P2 on a channel, now if it has room for it and
+ * later if not
+ * returns 1 on success, 0 if out of memory
+ */
+int mux_write(Mux *m, int chan, const uint8_t *data, int len);
+
+#endif
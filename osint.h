@@ -42,16 +42,26 @@ void serial_use_rts_for_reset(int use_rts);
 int serial_find(const char* prefix, int (*check)(const char* port, void* data), void* data);
 int serial_init(const char *port, unsigned long baud);
 int serial_baud(unsigned long baud);
+unsigned long serial_actual_baud(void);
 void serial_done(void);
+int serial_probe(char **ports, int n, unsigned long baud, const char *probe,
+                 const char *reply, char *version, int first,
+                 int resend, int timeout);
 int tx(uint8_t* buff, int n);
+int tx_flush(void);
+void tx_stats(unsigned long *bytes, unsigned long *calls);
 int rx(uint8_t* buff, int n);
 int rx_timeout(uint8_t* buff, int n, int timeout);
 void hwreset(void);
 int flush_input(void);
 int wait_drain(void);
+int serial_start_io(void);
+void rx_stats(unsigned long *high_water, unsigned long *overruns);
+int serial_input_fd(void);
 
-/* terminal mode */
+/* terminal mode; check_for_exit has 2 set to serve files, 4 for channels */
 void terminal_mode(int check_for_exit, int pst_mode);
+int telemetry_open(const char *spec);
 
 /* miscellaneous functions */
 void msleep(int ms);
@@ -62,6 +72,8 @@ unsigned long long elapsedms(void);
 /* external filesystem functions in the u9fs/u9fs.c */
 int u9fs_init(char *user_root);
 int u9fs_process(int count, char *buf);
+int u9fs_maxmsg(void);
+void u9fs_reply_with(long (*fn)(void *buf, long n));
 
 /* in loadp2.c */
 extern int waitAtExit; // if nonzero prompt before exiting
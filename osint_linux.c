@@ -44,18 +44,46 @@
 #include <limits.h>
 #include <signal.h>
 #include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
 
 #ifdef MACOSX
 #include <IOKit/serial/ioss.h>
 #endif
 
+#if defined(__linux__) && defined(TCGETS2)
+/* termios2.c can set any baud rate the driver manages */
+#define HAVE_TERMIOS2
+#endif
+
 #include "osint.h"
+#include "termios2.h"
+#include "transport.h"
+#include "ring.h"
+#include "reactor.h"
+#include "demux.h"
+#include "mux.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
-typedef int HANDLE;
-static HANDLE hSerial = -1;
-static struct termios old_sparm;
-static unsigned long last_baud = -1;
-static char last_port[PATH_MAX];
+/* the port the routines in osint.h work on */
+static Transport *cur = NULL;
+
+/*
+ * transmit buffer: tx() just appends to the port's txbuf, and the data
+ * is written out by tx_flush() when the buffer fills, and before anything
+ * that depends on the data having been sent (draining, receiving, pauses,
+ * resets) so callers sending a byte at a time don't cost a system call
+ * per byte
+ */
+// the i/o thread counts what it sends, so these are shared with it
+static atomic_ulong tx_byte_count = 0;
+static atomic_ulong tx_write_count = 0;
 
 /* normally we use DTR for reset but setting this variable to non-zero will use RTS instead */
 static int use_rts_for_reset = 0;
@@ -144,6 +172,14 @@ static int set_baud(struct termios *sparm, unsigned long baud)
             tbaud = B9600;
             break;
         default:
+#ifdef HAVE_TERMIOS2
+            // use some standard rate for now; returning 2 tells
+            // tty_open_fd to replace it with set_custom_baud() once
+            // the port is configured
+            chk("cfsetispeed", cfsetispeed(sparm, B38400));
+            chk("cfsetospeed", cfsetospeed(sparm, B38400));
+            return 2;
+#else
             tbaud = baud;
             printf("Unsupported baudrate %lu. Use ", baud);
 #ifdef B921600
@@ -165,6 +201,7 @@ static int set_baud(struct termios *sparm, unsigned long baud)
             serial_done();
             promptexit(2);
             break;
+#endif
     }
 
     /* set raw input */
@@ -174,37 +211,35 @@ static int set_baud(struct termios *sparm, unsigned long baud)
 }
 #endif /* !MACOSX */
 
-/**
- * open serial port
- * @param port - COMn port name
- * @param baud - baud rate
- * @returns 1 for success and 0 for failure
+/*
+ * open a serial port and set it up for raw i/o at "baud", recording the
+ * rate it really runs at in *actual
+ * returns the file descriptor, or -1 on failure
  */
-int serial_init(const char* port, unsigned long baud)
+static int tty_open_fd(const char *port, unsigned long baud, unsigned long *actual)
 {
     struct termios sparm;
+    int fd;
+#if !defined(MACOSX)
+    int custom_baud;
+#endif
 
     /* open the port */
 #if defined(MACOSX)
     speed_t speed = (speed_t) baud;
 
-    hSerial = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    fd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
 #else
-    hSerial = open(port, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK);
+    fd = open(port, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK);
 #endif
-    if(hSerial == -1) {
+    if(fd == -1) {
         //printf("error: opening '%s' -- %s\n", port, strerror(errno));
-        return 0;
+        return -1;
     }
-    last_baud = baud;
-    strncpy(last_port, port, PATH_MAX-1);
-    
-    signal(SIGINT, sigint_handler);    
-    fcntl(hSerial, F_SETFL, 0);
+    fcntl(fd, F_SETFL, 0);
     
     /* get the current options */
-    chk("tcgetattr", tcgetattr(hSerial, &old_sparm));
-    sparm = old_sparm;
+    chk("tcgetattr", tcgetattr(fd, &sparm));
     
     /* set raw input */
     cfmakeraw(&sparm);
@@ -215,26 +250,582 @@ int serial_init(const char* port, unsigned long baud)
     cfsetospeed(&sparm, B9600); // dummy speed, overridden later
     cfsetispeed(&sparm, B9600); // dummy speed
 #else    
-    if (!set_baud(&sparm, baud)) {
-        close(hSerial);
+    custom_baud = set_baud(&sparm, baud);
+    if (!custom_baud) {
+        close(fd);
         printf("failure setting baud %ld\n", (long)baud);
-        return 0;
+        return -1;
     }
 #endif
     
     /* set the options */
-    chk("tcsetattr", tcsetattr(hSerial, TCSANOW, &sparm));
+    chk("tcsetattr", tcsetattr(fd, TCSANOW, &sparm));
+    *actual = baud;
+
+#if !defined(MACOSX)
+    if (custom_baud == 2) {
+        if (!set_custom_baud(fd, baud, actual)) {
+            close(fd);
+            printf("Unsupported baudrate %lu\n", baud);
+            return -1;
+        }
+    }
+#endif
 
 #ifdef MACOSX
-    if (ioctl(hSerial, IOSSIOSPEED, &speed) != 0)
+    if (ioctl(fd, IOSSIOSPEED, &speed) != 0)
     {
-        close(hSerial);
+        close(fd);
         printf("failure setting speed %ld\n", (long)baud);
-        return 0;
+        return -1;
     }
 #endif    
-    chk("tcflush", tcflush(hSerial, TCIFLUSH));
+    chk("tcflush", tcflush(fd, TCIFLUSH));
     
+    return fd;
+}
+
+static int tty_open(Transport *t, const char *name, unsigned long baud)
+{
+    t->fd = t->wfd = tty_open_fd(name, baud, &t->actual_baud);
+    return t->fd != -1;
+}
+
+/*
+ * On Linux this gets tricky, changing baud on an already open handle
+ * drops DTR and resets the board. So we have to initialize a new
+ * connection and then close the old one.
+ */
+static int tty_set_baud(Transport *t, unsigned long baud)
+{
+    unsigned long actual;
+    int fd = tty_open_fd(t->name, baud, &actual);
+
+    if (fd == -1) {
+        return 0;
+    }
+    close(t->fd);
+    t->fd = t->wfd = fd;
+    t->actual_baud = actual;
+    return 1;
+}
+
+static void tty_reset_line(Transport *t, int on)
+{
+    int cmd = use_rts_for_reset ? TIOCM_RTS : TIOCM_DTR;
+
+    ioctl(t->fd, on ? TIOCMBIS : TIOCMBIC, &cmd);
+}
+
+static int tty_flush_input(Transport *t)
+{
+    return tcflush(t->fd, TCIFLUSH);
+}
+
+static int tty_drain(Transport *t)
+{
+    return tcdrain(t->fd);
+}
+
+static void tty_close(Transport *t)
+{
+    tcflush(t->fd, TCIOFLUSH);
+    ioctl(t->fd, TIOCNXCL);
+    close(t->fd);
+}
+
+static int fd_read(Transport *t, uint8_t *buf, int n)
+{
+    return read(t->fd, buf, n);
+}
+
+static int fd_write(Transport *t, const uint8_t *buf, int n)
+{
+    return write(t->wfd, buf, n);
+}
+
+static void fd_close(Transport *t)
+{
+    if (t->wfd != t->fd) {
+        close(t->wfd);
+    }
+    close(t->fd);
+}
+
+/*
+ * the baud rate of a TCP bridge is set at its far end, and a loopback
+ * has none, so for those we just remember what was asked for
+ */
+static int nominal_set_baud(Transport *t, unsigned long baud)
+{
+    t->actual_baud = baud;
+    return 1;
+}
+
+static int discard_input(Transport *t)
+{
+    uint8_t buf[256];
+    struct pollfd pfd;
+
+    pfd.fd = t->fd;
+    pfd.events = POLLIN;
+    while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+        if (t->ops->read(t, buf, sizeof(buf)) <= 0) {
+            break;
+        }
+    }
+    return 0;
+}
+
+static const TransportOps tty_ops = {
+    "", tty_open, tty_set_baud, fd_read, fd_write, tty_reset_line,
+    tty_flush_input, tty_drain, tty_close
+};
+
+/*
+ * a raw TCP connection to a serial bridge (ser2net, or the WiFi bridges
+ * on some boards), named "tcp:host:port"
+ */
+static int tcp_open(Transport *t, const char *name, unsigned long baud)
+{
+    char host[256];
+    const char *port = strrchr(name, ':');
+    struct addrinfo hints, *res, *ai;
+    int fd = -1;
+    int one = 1;
+    int r;
+
+    if (!port || port == name || port - name >= (int)sizeof(host)) {
+        printf("error: expected tcp:host:port, not tcp:%s\n", name);
+        return 0;
+    }
+    memcpy(host, name, port - name);
+    host[port - name] = 0;
+    port++;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    r = getaddrinfo(host, port, &hints, &res);
+    if (r != 0) {
+        printf("error: looking up %s: %s\n", host, gai_strerror(r));
+        return 0;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd == -1) {
+        printf("error: connecting to %s: %s\n", name, strerror(errno));
+        return 0;
+    }
+    // the loader protocol is small records waiting on short replies
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    t->fd = t->wfd = fd;
+    t->actual_baud = baud;
+    return 1;
+}
+
+static int tcp_write(Transport *t, const uint8_t *buf, int n)
+{
+    // a bridge that goes away should be an error, not a SIGPIPE
+    return send(t->fd, buf, n, MSG_NOSIGNAL);
+}
+
+static int tcp_drain(Transport *t)
+{
+#ifdef TIOCOUTQ
+    int queued;
+    int i;
+
+    // wait (a while) for the kernel to get it all onto the network
+    for (i = 0; i < 1000; i++) {
+        if (ioctl(t->fd, TIOCOUTQ, &queued) != 0 || queued <= 0) {
+            break;
+        }
+        usleep(1000);
+    }
+#endif
+    return 0;
+}
+
+static const TransportOps tcp_ops = {
+    "tcp:", tcp_open, nominal_set_baud, fd_read, tcp_write, NULL,
+    discard_input, tcp_drain, fd_close
+};
+
+/*
+ * an in-process loopback, "loop:", which gives back whatever is sent
+ * to it; handy for trying out and timing the host side without a board
+ * it holds a pipe's worth (64K on Linux) of data nobody has read
+ */
+static int loop_open(Transport *t, const char *name, unsigned long baud)
+{
+    int p[2];
+
+    if (pipe(p) != 0) {
+        printf("error: creating loopback: %s\n", strerror(errno));
+        return 0;
+    }
+    t->fd = p[0];
+    t->wfd = p[1];
+    t->actual_baud = baud;
+    return 1;
+}
+
+static int loop_drain(Transport *t)
+{
+    return 0;
+}
+
+static const TransportOps loop_ops = {
+    "loop:", loop_open, nominal_set_baud, fd_read, fd_write, NULL,
+    discard_input, loop_drain, fd_close
+};
+
+/* the serial port comes last, since it takes any name */
+static const TransportOps *transports[] = { &tcp_ops, &loop_ops, &tty_ops };
+#define NUM_TRANSPORTS (sizeof(transports) / sizeof(transports[0]))
+
+/*
+ * background i/o: once the program is running, a thread keeps the port
+ * drained into a ring, so that nothing is lost while the main thread is
+ * busy (serving a 9P request, say) and the P2 keeps printing, and sends
+ * whatever the main thread queues in a second ring
+ */
+#define RX_RING_SIZE (1024*1024)
+#define TX_RING_SIZE (64*1024)
+
+struct transport_io {
+    pthread_t thread;
+    Ring rx;
+    Ring tx;
+    int rx_note[2];     /* a byte is written here when input arrives */
+    int tx_note[2];     /* ... and here when all the output has gone */
+    int wake[2];        /* tells the thread there is output, or to stop */
+    atomic_int stop;
+    atomic_int eof;     /* the thread has stopped, or the port went away */
+};
+
+static int open_notes(int fds[2])
+{
+    if (pipe(fds) != 0) {
+        fds[0] = fds[1] = -1;
+        return 0;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    return 1;
+}
+
+static void close_notes(int fds[2])
+{
+    if (fds[0] != -1) {
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+
+static void note(int fd)
+{
+    uint8_t c = 0;
+
+    // if the pipe is full a note is already waiting
+    if (write(fd, &c, 1) < 0) {
+        return;
+    }
+}
+
+static void clear_notes(int fd)
+{
+    uint8_t buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+static void set_blocking(Transport *t, int blocking)
+{
+    int fds[2] = { t->fd, t->wfd };
+    int i, flags;
+
+    for (i = 0; i < 2; i++) {
+        flags = fcntl(fds[i], F_GETFL);
+        fcntl(fds[i], F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+    }
+}
+
+static void *io_thread(void *arg)
+{
+    Transport *t = (Transport *)arg;
+    struct transport_io *io = t->io;
+    uint8_t buf[4096];
+    struct pollfd pfd[3];
+    const uint8_t *out;
+    int n, w;
+
+    while (!atomic_load(&io->stop)) {
+        pfd[0].fd = t->fd;
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd = io->wake[0];
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+        // (negative descriptors are ignored)
+        pfd[2].fd = ring_used(&io->tx) ? t->wfd : -1;
+        pfd[2].events = POLLOUT;
+        pfd[2].revents = 0;
+        if (poll(pfd, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfd[1].revents) {
+            clear_notes(io->wake[0]);
+        }
+        if (pfd[0].revents & POLLIN) {
+            n = t->ops->read(t, buf, sizeof(buf));
+            if (n > 0) {
+                w = ring_write(&io->rx, buf, n);
+                atomic_fetch_add(&io->rx.overruns, n - w);
+                note(io->rx_note[1]);
+            } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+                break;
+            }
+        } else if (pfd[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            break;
+        }
+        if (pfd[2].revents & POLLOUT) {
+            out = ring_peek(&io->tx, &n);
+            w = t->ops->write(t, out, n);
+            tx_write_count++;
+            if (w > 0) {
+                // count the bytes before io_wait_sent() can see them gone
+                tx_byte_count += w;
+                ring_skip(&io->tx, w);
+            } else if (errno != EINTR && errno != EAGAIN) {
+                break;
+            }
+            if (!ring_used(&io->tx)) {
+                note(io->tx_note[1]);
+            }
+        } else if (pfd[2].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            break;
+        }
+    }
+    atomic_store(&io->eof, 1);
+    note(io->rx_note[1]);
+    note(io->tx_note[1]);
+    return NULL;
+}
+
+static void io_free(struct transport_io *io)
+{
+    ring_free(&io->rx);
+    ring_free(&io->tx);
+    close_notes(io->rx_note);
+    close_notes(io->tx_note);
+    close_notes(io->wake);
+    free(io);
+}
+
+static int io_start(Transport *t)
+{
+    struct transport_io *io = calloc(1, sizeof(*io));
+
+    if (!io) {
+        return 0;
+    }
+    io->rx_note[0] = io->tx_note[0] = io->wake[0] = -1;
+    if (!ring_init(&io->rx, RX_RING_SIZE) || !ring_init(&io->tx, TX_RING_SIZE)
+        || !open_notes(io->rx_note) || !open_notes(io->tx_note) || !open_notes(io->wake))
+    {
+        io_free(io);
+        return 0;
+    }
+    atomic_init(&io->stop, 0);
+    atomic_init(&io->eof, 0);
+    // the thread must never block in a write while there is input
+    set_blocking(t, 0);
+    t->io = io;
+    if (pthread_create(&io->thread, NULL, io_thread, t) != 0) {
+        t->io = NULL;
+        set_blocking(t, 1);
+        io_free(io);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * wait for the thread to send everything queued, giving up if it stops
+ * making progress for a second
+ */
+static void io_wait_sent(struct transport_io *io)
+{
+    struct pollfd pfd;
+    unsigned left, last = 0;
+
+    for (;;) {
+        clear_notes(io->tx_note[0]);
+        left = ring_used(&io->tx);
+        if (!left || atomic_load(&io->eof) || left == last) {
+            return;
+        }
+        last = left;
+        pfd.fd = io->tx_note[0];
+        pfd.events = POLLIN;
+        poll(&pfd, 1, 1000);
+    }
+}
+
+static void io_stop(Transport *t)
+{
+    struct transport_io *io = t->io;
+
+    if (!io) {
+        return;
+    }
+    io_wait_sent(io);
+    atomic_store(&io->stop, 1);
+    note(io->wake[1]);
+    pthread_join(io->thread, NULL);
+    t->io = NULL;
+    set_blocking(t, 1);
+    io_free(io);
+}
+
+/* hand n bytes to the thread to send */
+static int io_queue(struct transport_io *io, const uint8_t *data, int n)
+{
+    int w;
+
+    while (n > 0) {
+        if (atomic_load(&io->eof)) {
+            printf("Error writing port\n");
+            return 0;
+        }
+        w = ring_write(&io->tx, data, n);
+        data += w;
+        n -= w;
+        note(io->wake[1]);
+        if (n > 0) {
+            io_wait_sent(io);
+        }
+    }
+    return 1;
+}
+
+/*
+ * fetch up to n bytes of input, waiting up to timeout ms (-1 for ever)
+ * for some to arrive
+ * returns the count, 0 if there was none
+ */
+static int io_read(struct transport_io *io, uint8_t *buf, int n, int timeout)
+{
+    struct pollfd pfd;
+    int got;
+
+    for (;;) {
+        clear_notes(io->rx_note[0]);
+        got = ring_read(&io->rx, buf, n);
+        if (got > 0 && ring_used(&io->rx) > 0) {
+            // there is more, so anyone waiting on the note should wake again
+            note(io->rx_note[1]);
+        }
+        if (got > 0 || atomic_load(&io->eof)) {
+            return got;
+        }
+        pfd.fd = io->rx_note[0];
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeout) <= 0) {
+            return 0;
+        }
+    }
+}
+
+static void io_discard_input(struct transport_io *io)
+{
+    uint8_t buf[256];
+
+    clear_notes(io->rx_note[0]);
+    while (ring_read(&io->rx, buf, sizeof(buf)) > 0)
+        ;
+}
+
+static int flush_tx(Transport *t);
+
+Transport *transport_open(const char *port, unsigned long baud)
+{
+    const TransportOps *ops = &tty_ops;
+    Transport *t;
+    int i;
+
+    for (i = 0; i < NUM_TRANSPORTS; i++) {
+        if (!strncmp(port, transports[i]->prefix, strlen(transports[i]->prefix))) {
+            ops = transports[i];
+            break;
+        }
+    }
+    t = calloc(1, sizeof(*t));
+    if (!t) {
+        printf("Out of memory opening %s\n", port);
+        return NULL;
+    }
+    t->ops = ops;
+    t->fd = t->wfd = -1;
+    strncpy(t->name, port, sizeof(t->name) - 1);
+    t->baud = baud;
+    if (!ops->open(t, port + strlen(ops->prefix), baud)) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void transport_close(Transport *t)
+{
+    flush_tx(t);
+    io_stop(t);
+    t->ops->close(t);
+    free(t);
+}
+
+Transport *serial_select(Transport *t)
+{
+    Transport *old = cur;
+
+    if (old) {
+        flush_tx(old);
+    }
+    cur = t;
+    return old;
+}
+
+/**
+ * open serial port
+ * @param port - COMn port name
+ * @param baud - baud rate
+ * @returns 1 for success and 0 for failure
+ */
+int serial_init(const char* port, unsigned long baud)
+{
+    Transport *t = transport_open(port, baud);
+
+    if (!t) {
+        return 0;
+    }
+    signal(SIGINT, sigint_handler);    
+    cur = t;
     return 1;
 }
 
@@ -242,21 +833,72 @@ int serial_init(const char* port, unsigned long baud)
  * change the baud rate of the serial port
  * @param baud - baud rate
  * @returns 1 for success and 0 for failure
- * On Linux this gets tricky, changiing baud on an already open
- * handle drops DTR and resets the board. So we have to initialize
- * new connection and then close the old one.
  */
 int serial_baud(unsigned long baud)
 {
-    if (baud != last_baud) {
-        HANDLE oldSerial = hSerial;
-        if (!serial_init(last_port, baud)) {
-            printf("serial_init of %s failed\n", last_port);
-            promptexit(1);
+    int background = cur->io != NULL;
+    int r = 1;
+
+    tx_flush();
+    if (baud != cur->baud) {
+        // the i/o thread can't be using the port while it changes
+        io_stop(cur);
+        if (!cur->ops->set_baud(cur, baud)) {
+            // carry on with the port as it was
+            printf("could not change %s to %lu baud\n", cur->name, baud);
+            r = 0;
+        } else {
+            cur->baud = baud;
+        }
+        if (background) {
+            io_start(cur);
         }
-        close(oldSerial);
     }
-    return 1;
+    return r;
+}
+
+/**
+ * from now on, keep the port drained (and send to it) from a thread of
+ * its own, rather than only when it is read
+ * @returns 1 for success and 0 for failure
+ */
+int serial_start_io(void)
+{
+    if (!cur) {
+        return 0;
+    }
+    return cur->io ? 1 : io_start(cur);
+}
+
+/**
+ * fetch receive statistics from the i/o thread: the most input it has
+ * held unread, and the bytes it had to drop because it was full
+ */
+void rx_stats(unsigned long *high_water, unsigned long *overruns)
+{
+    *high_water = cur && cur->io ? atomic_load(&cur->io->rx.high_water) : 0;
+    *overruns = cur && cur->io ? atomic_load(&cur->io->rx.overruns) : 0;
+}
+
+/**
+ * a descriptor that becomes readable when there is input for rx(), so
+ * the port can be waited on along with other things
+ */
+int serial_input_fd(void)
+{
+    if (!cur) {
+        return -1;
+    }
+    return cur->io ? cur->io->rx_note[0] : cur->fd;
+}
+
+/**
+ * fetch the baud rate the port is really running at
+ * (may differ from the requested one for non-standard rates)
+ */
+unsigned long serial_actual_baud(void)
+{
+    return cur ? cur->actual_baud : 0;
 }
 
 /**
@@ -264,7 +906,12 @@ int serial_baud(unsigned long baud)
  */
 int flush_input(void)
 {
-    return tcflush(hSerial, TCIFLUSH);
+    tx_flush();
+    if (cur->io) {
+        io_discard_input(cur->io);
+        return 0;
+    }
+    return cur->ops->flush_input(cur);
 }
 
 /**
@@ -272,7 +919,11 @@ int flush_input(void)
  */
 int wait_drain(void)
 {
-    return tcdrain(hSerial);
+    tx_flush();
+    if (cur->io) {
+        io_wait_sent(cur->io);
+    }
+    return cur->ops->drain(cur);
 }
 
 /**
@@ -280,15 +931,148 @@ int wait_drain(void)
  */
 void serial_done(void)
 {
-    if (hSerial != -1) {
-        tcflush(hSerial, TCIOFLUSH);
-        //tcsetattr(hSerial, TCSANOW, &old_sparm);
-        ioctl(hSerial, TIOCNXCL);
-        close(hSerial);
-        hSerial = -1;
+    if (cur) {
+        transport_close(cur);
+        cur = NULL;
     }
 }
 
+/**
+ * probe several serial ports at once
+ * every port is opened and reset together, then sent "probe" every
+ * "resend" milliseconds until it answers with something starting
+ * with "reply", or until "timeout" milliseconds have passed
+ * @param ports - port names
+ * @param n - number of ports
+ * @param baud - baud rate
+ * @param probe - string to send
+ * @param reply - expected start of the answer
+ * @param version - for each port, receives the character following
+ *                  "reply", or 0 if the port did not answer
+ * @param first - if non-zero stop at the first port to answer, and leave
+ *                it open as the current port; otherwise wait for all of
+ *                them and close them all
+ * @returns the index of the first port to answer, or -1 if none did
+ */
+int serial_probe(char **ports, int n, unsigned long baud, const char *probe,
+                 const char *reply, char *version, int first,
+                 int resend, int timeout)
+{
+    Transport **h;
+    char (*rbuf)[32];
+    int *rlen;
+    struct pollfd *pfd;
+    int *pidx;
+    int probelen = strlen(probe);
+    int replylen = strlen(reply);
+    unsigned long long now, next_send, deadline;
+    int winner = -1;
+    int pending = 0;
+    int i, np, r, on;
+
+    h = calloc(n, sizeof(*h));
+    rbuf = calloc(n, sizeof(*rbuf));
+    rlen = calloc(n, sizeof(*rlen));
+    pfd = calloc(n, sizeof(*pfd));
+    pidx = calloc(n, sizeof(*pidx));
+    if (!h || !rbuf || !rlen || !pfd || !pidx) {
+        printf("Out of memory probing ports\n");
+        promptexit(1);
+    }
+
+    // open everything first, so the resets all happen together
+    tx_flush();
+    for (i = 0; i < n; i++) {
+        version[i] = 0;
+        h[i] = transport_open(ports[i], baud);
+        if (h[i]) {
+            pending++;
+        }
+    }
+
+    if (pending) {
+        for (on = 1; on >= -1; on--) {
+            for (i = 0; i < n; i++)
+                if (h[i] && h[i]->ops->reset_line) h[i]->ops->reset_line(h[i], on != 0);
+            msleep(2);
+        }
+        for (i = 0; i < n; i++)
+            if (h[i]) h[i]->ops->flush_input(h[i]);
+        msleep(20); // wait for the P2s to become active
+    }
+
+    now = elapsedms();
+    next_send = now;
+    deadline = now + timeout;
+    while (pending && now < deadline) {
+        if (now >= next_send) {
+            for (i = 0; i < n; i++) {
+                if (!h[i] || version[i]) continue;
+                h[i]->ops->flush_input(h[i]);
+                rlen[i] = 0;
+                if (h[i]->ops->write(h[i], (const uint8_t *)probe, probelen) != probelen) {
+                    // the adapter went away; forget about it
+                    transport_close(h[i]);
+                    h[i] = NULL;
+                    pending--;
+                }
+            }
+            next_send = now + resend;
+        }
+        np = 0;
+        for (i = 0; i < n; i++) {
+            if (!h[i] || version[i]) continue;
+            pfd[np].fd = h[i]->fd;
+            pfd[np].events = POLLIN;
+            pfd[np].revents = 0;
+            pidx[np++] = i;
+        }
+        r = poll(pfd, np, (int)((next_send < deadline ? next_send : deadline) - now));
+        for (i = 0; r > 0 && i < np; i++) {
+            int p = pidx[i];
+            int got;
+
+            if (!pfd[i].revents) continue;
+            got = 0;
+            if (pfd[i].revents & POLLIN) {
+                got = h[p]->ops->read(h[p], (uint8_t *)rbuf[p] + rlen[p], sizeof(rbuf[p]) - 1 - rlen[p]);
+            }
+            if (got <= 0) {
+                transport_close(h[p]);
+                h[p] = NULL;
+                pending--;
+                continue;
+            }
+            rlen[p] += got;
+            if (rlen[p] > replylen && !memcmp(rbuf[p], reply, replylen)) {
+                version[p] = rbuf[p][replylen];
+                pending--;
+                if (winner < 0) winner = p;
+            } else if (rlen[p] == sizeof(rbuf[p]) - 1) {
+                rlen[p] = 0; // noise; wait for the next probe
+            }
+        }
+        if (first && winner >= 0) break;
+        now = elapsedms();
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!h[i]) continue;
+        if (first && i == winner) {
+            h[i]->ops->flush_input(h[i]);
+            cur = h[i];
+        } else {
+            transport_close(h[i]);
+        }
+    }
+    free(pidx);
+    free(pfd);
+    free(rlen);
+    free(rbuf);
+    free(h);
+    return winner;
+}
+
 /**
  * receive a buffer
  * @param buff - char pointer to buffer
@@ -297,23 +1081,100 @@ void serial_done(void)
  */
 int rx(uint8_t* buff, int n)
 {
-    ssize_t bytes = read(hSerial, buff, n);
+    int bytes;
+
+    tx_flush();
+    if (cur->io) {
+        bytes = io_read(cur->io, buff, n, -1);
+    } else {
+        bytes = cur->ops->read(cur, buff, n);
+    }
     if(bytes < 1) {
-        printf("Error reading port: %d\n", (int)bytes);
+        printf("Error reading port: %d\n", bytes);
         return 0;
     }
-    return (int)bytes;
+    return bytes;
+}
+
+/*
+ * write n bytes to the port, coping with short writes and with
+ * the port being temporarily unable to accept data
+ */
+static int write_all(Transport *t, const uint8_t *buff, int n)
+{
+    int bytes;
+    struct pollfd pfd;
+
+    while (n > 0) {
+        bytes = t->ops->write(t, buff, n);
+        tx_write_count++;
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                pfd.fd = t->wfd;
+                pfd.events = POLLOUT;
+                poll(&pfd, 1, 1000);
+                continue;
+            }
+            printf("Error writing port: %s\n", strerror(errno));
+            return 0;
+        }
+        buff += bytes;
+        n -= bytes;
+        tx_byte_count += bytes;
+    }
+    return 1;
+}
+
+/* send n bytes, or queue them for the i/o thread if it is running */
+static int send_all(Transport *t, const uint8_t *buff, int n)
+{
+    return t->io ? io_queue(t->io, buff, n) : write_all(t, buff, n);
+}
+
+static int flush_tx(Transport *t)
+{
+    int r = 1;
+
+    if (t->txbuf_len > 0) {
+        r = send_all(t, t->txbuf, t->txbuf_len);
+    }
+    t->txbuf_len = 0;
+    return r;
+}
+
+/**
+ * write out any buffered transmit data
+ * @returns zero on failure
+ */
+int tx_flush(void)
+{
+    return cur ? flush_tx(cur) : 1;
+}
+
+/**
+ * fetch transmit statistics: bytes sent, and write() calls used to do it
+ */
+void tx_stats(unsigned long *bytes, unsigned long *calls)
+{
+    if (cur && cur->io) {
+        io_wait_sent(cur->io);
+    }
+    *bytes = atomic_load(&tx_byte_count);
+    *calls = atomic_load(&tx_write_count);
 }
 
 /**
  * transmit a buffer
+ * the data is buffered; see tx_flush()
  * @param buff - char pointer to buffer
  * @param n - number of bytes in buffer to send
  * @returns zero on failure
  */
 int tx(uint8_t* buff, int n)
 {
-    ssize_t bytes;
 #if 0
     int j = 0;
     while(j < n) {
@@ -321,12 +1182,18 @@ int tx(uint8_t* buff, int n)
     }
     printf("tx %d byte(s)\n",n);
 #endif
-    bytes = write(hSerial, buff, n);
-    if(bytes != n) {
-        printf("Error writing port\n");
-        return 0;
+    if (cur->txbuf_len + n > TX_BUFSIZE) {
+        if (!flush_tx(cur)) {
+            return 0;
+        }
     }
-    return (int)bytes;
+    if (n >= TX_BUFSIZE) {
+        // too big to be worth copying
+        return send_all(cur, buff, n) ? n : 0;
+    }
+    memcpy(cur->txbuf + cur->txbuf_len, buff, n);
+    cur->txbuf_len += n;
+    return n;
 }
 
 /**
@@ -338,47 +1205,57 @@ int tx(uint8_t* buff, int n)
  */
 int rx_timeout(uint8_t* buff, int n, int timeout)
 {
-    ssize_t bytes = 0;
+    int bytes = 0;
     struct timeval toval;
     fd_set set;
 
+    tx_flush();
+    if (cur->io) {
+        bytes = io_read(cur->io, buff, n, timeout);
+        return bytes > 0 ? bytes : SERIAL_TIMEOUT;
+    }
     FD_ZERO(&set);
-    FD_SET(hSerial, &set);
+    FD_SET(cur->fd, &set);
 
     toval.tv_sec = timeout / 1000;
     toval.tv_usec = (timeout % 1000) * 1000;
 
-    if (select(hSerial + 1, &set, NULL, NULL, &toval) > 0) {
-        if (FD_ISSET(hSerial, &set))
-            bytes = read(hSerial, buff, n);
+    if (select(cur->fd + 1, &set, NULL, NULL, &toval) > 0) {
+        if (FD_ISSET(cur->fd, &set))
+            bytes = cur->ops->read(cur, buff, n);
     }
 
-    return (int)(bytes > 0 ? bytes : SERIAL_TIMEOUT);
+    return bytes > 0 ? bytes : SERIAL_TIMEOUT;
 }
 
 /**
  * hwreset ... resets Propeller hardware using DTR or RTS
- * @param sparm - pointer to DCB serial control struct
+ * (ports without a reset line are left alone)
  * @returns void
  */
 void hwreset(void)
 {
-    int cmd = use_rts_for_reset ? TIOCM_RTS : TIOCM_DTR;
-    ioctl(hSerial, TIOCMBIS, &cmd); /* assert bit */
-    msleep(2);
-    ioctl(hSerial, TIOCMBIC, &cmd); /* clear bit */
-    msleep(2);
-    ioctl(hSerial, TIOCMBIS, &cmd); /* assert bit */
-    msleep(2);
-    tcflush(hSerial, TCIFLUSH);
+    tx_flush();
+    if (cur->ops->reset_line) {
+        cur->ops->reset_line(cur, 1); /* assert bit */
+        msleep(2);
+        cur->ops->reset_line(cur, 0); /* clear bit */
+        msleep(2);
+        cur->ops->reset_line(cur, 1); /* assert bit */
+        msleep(2);
+    }
+    flush_input();
 }
 
 /**
  * sleep for ms milliseconds
+ * any buffered output is sent first, since pauses are generally
+ * there to give the other end time to deal with it
  * @param ms - time to wait in milliseconds
  */
 void msleep(int ms)
 {
+    tx_flush();
 #if 0
     volatile struct timeb t0, t1;
     do {
@@ -392,108 +1269,279 @@ void msleep(int ms)
 #endif
 }
 
+/* where the telemetry channel goes, if anywhere: a TCP connection or a file */
+static Transport *telemetry;
+static int telemetry_fd = -1;
+
+/**
+ * save the program's telemetry channel to spec, a file or "tcp:host:port"
+ * @returns 1 for success and 0 for failure
+ */
+int telemetry_open(const char *spec)
+{
+    if (!strncmp(spec, "tcp:", 4)) {
+        telemetry = transport_open(spec, 0);
+        return telemetry != NULL;
+    }
+    telemetry_fd = open(spec, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (telemetry_fd == -1) {
+        printf("error: opening %s: %s\n", spec, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+static void telemetry_write(const uint8_t *data, int len)
+{
+    int n;
+
+    while (len > 0) {
+        if (telemetry) {
+            n = telemetry->ops->write(telemetry, data, len);
+        } else if (telemetry_fd != -1) {
+            n = write(telemetry_fd, data, len);
+        } else {
+            return;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // don't let a dead sink hold up everything else
+            printf("telemetry: %s; no longer saved\r\n", n < 0 ? strerror(errno) : "closed");
+            if (telemetry) {
+                transport_close(telemetry);
+                telemetry = NULL;
+            } else {
+                close(telemetry_fd);
+                telemetry_fd = -1;
+            }
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+/* bytes read from the port at a time in terminal mode */
+#define TERM_BUFSIZE 4096
+
+typedef struct terminal {
+    Reactor *reactor;
+    Demux demux;
+    Mux mux;
+    int pst_mode;
+    int files;          /* serving 9P requests */
+    int sawexit_valid;
+    int exitcode;
+    uint8_t buf[TERM_BUFSIZE];
+} Terminal;
+
+static void term_text(void *arg, const uint8_t *data, int len)
+{
+    Terminal *term = (Terminal *)arg;
+    const uint8_t *cr;
+    int n;
+
+    // PST wants a newline after each carriage return
+    while (term->pst_mode && (cr = memchr(data, '\r', len)) != NULL) {
+        n = cr + 1 - data;
+        write(fileno(stdout), data, n);
+        write(fileno(stdout), "\n", 1);
+        data += n;
+        len -= n;
+    }
+    if (len > 0) {
+        write(fileno(stdout), data, len);
+    }
+}
+
+static void term_exit(void *arg, int code)
+{
+    Terminal *term = (Terminal *)arg;
+
+    term->exitcode = code;
+    term->sawexit_valid = 1;
+    reactor_stop(term->reactor);
+}
+
+static void term_frame(void *arg, const uint8_t *msg, int len)
+{
+    (void)arg;
+    u9fs_process(len, (char *)msg);
+}
+
+static void term_chunk(void *arg, int chan, const uint8_t *data, int len)
+{
+    Terminal *term = (Terminal *)arg;
+
+    mux_input(&term->mux, chan, data, len);
+}
+
+static const DemuxOps term_ops = { term_text, term_exit, term_frame, term_chunk };
+
+static void term_send(void *arg, const uint8_t *data, int len)
+{
+    (void)arg;
+    send_all(cur, data, len);
+}
+
+/* data from one of the P2's channels */
+static void term_deliver(void *arg, int chan, const uint8_t *data, int len)
+{
+    Terminal *term = (Terminal *)arg;
+
+    switch (chan) {
+    case MUX_CONSOLE:
+        term_text(arg, data, len);
+        break;
+    case MUX_9P:
+        if (term->files) {
+            term_frame(arg, data, len);
+        }
+        break;
+    case MUX_TELEMETRY:
+        telemetry_write(data, len);
+        break;
+    }
+}
+
+/* once the P2 uses channels, 9P replies go back on one */
+static Mux *reply_mux;
+
+static long term_reply(void *buf, long n)
+{
+    return mux_write(reply_mux, MUX_9P, buf, n) ? n : -1;
+}
+
+static void term_started(void *arg)
+{
+    Terminal *term = (Terminal *)arg;
+
+    reply_mux = &term->mux;
+    u9fs_reply_with(term_reply);
+}
+
+static const MuxOps term_mux_ops = { term_send, term_deliver, term_started };
+
+/* output from the P2 */
+static void term_port(void *arg)
+{
+    Terminal *term = (Terminal *)arg;
+    int cnt;
+
+    if (cur->io) {
+        cnt = io_read(cur->io, term->buf, TERM_BUFSIZE, 0);
+    } else {
+        cnt = cur->ops->read(cur, term->buf, TERM_BUFSIZE);
+    }
+    if (cnt > 0) {
+        demux_input(&term->demux, term->buf, cnt);
+    }
+}
+
+/* keys typed by the user */
+static void term_keys(void *arg)
+{
+    Terminal *term = (Terminal *)arg;
+    char buf[256];
+    int cnt, i;
+
+    cnt = read(STDIN_FILENO, buf, sizeof(buf));
+    if (cnt <= 0) {
+        // nothing more to send, but keep showing the output
+        reactor_unwatch(term->reactor, STDIN_FILENO);
+        return;
+    }
+    for (i = 0; i < cnt; ++i) {
+        //printf("%02x\n", buf[i]);
+        if (buf[i] == EXIT_CHAR0 || buf[i] == EXIT_CHAR1) {
+            waitAtExit = 0; // user chose to quit
+            reactor_stop(term->reactor);
+            return;
+        }
+    }
+    if (term->mux.active) {
+        mux_write(&term->mux, MUX_CONSOLE, (uint8_t *)buf, cnt);
+    } else {
+        send_all(cur, (uint8_t *)buf, cnt);
+    }
+}
+
 /**
  * simple terminal emulator
  */
 void terminal_mode(int runterm_mode, int pst_mode)
 {
     struct termios oldt, newt;
-    char buf[128], realbuf[256]; // double in case buf is filled with \r in PST mode
-    ssize_t cnt;
-    fd_set set;
-    int exit_char = 0xdead; /* not a valid character */
-    int sawexit_char = 0;
-    int sawexit_valid = 0; 
-    int exitcode = 0;
-    int continue_terminal = 1;
-    int check_for_exit = runterm_mode != 0;
-    int check_for_files = runterm_mode & 2;
+    Terminal *term;
+    int flags = 0;
+    int rfd, sawexit_valid, exitcode;
     
+    tx_flush();
+    if (runterm_mode) {
+        flags |= DEMUX_EXIT;
+    }
+    if (runterm_mode & 2) {
+        flags |= DEMUX_FILES;
+    }
+    if (runterm_mode & 4) {
+        flags |= DEMUX_CHANNELS;
+    }
+    term = calloc(1, sizeof(*term));
+    if (!term) {
+        printf("Could not start the terminal\n");
+        return;
+    }
+    term->reactor = reactor_new();
+    if (!term->reactor
+        || demux_init(&term->demux, flags, u9fs_maxmsg(), &term_ops, term) != 0
+        || mux_init(&term->mux, u9fs_maxmsg(), &term_mux_ops, term) != 0)
+    {
+        printf("Could not start the terminal\n");
+        goto done;
+    }
+    term->pst_mode = pst_mode;
+    term->files = runterm_mode & 2;
+
+    rfd = serial_input_fd();
     if (isatty(STDIN_FILENO)) {
         tcgetattr(STDIN_FILENO, &oldt);
         newt = oldt;
         cfmakeraw(&newt);
         tcsetattr(STDIN_FILENO, TCSANOW, &newt);
     }
-    if (check_for_exit)
-      {
-        exit_char = 0xff;
-      }
 
 #if 0
     /* make it possible to detect breaks */
-    tcgetattr(hSerial, &newt);
+    tcgetattr(cur->fd, &newt);
     newt.c_iflag &= ~IGNBRK;
     newt.c_iflag |= PARMRK;
-    tcsetattr(hSerial, TCSANOW, &newt);
+    tcsetattr(cur->fd, TCSANOW, &newt);
 #endif
 
-    do {
-        FD_ZERO(&set);
-        FD_SET(hSerial, &set);
-        FD_SET(STDIN_FILENO, &set);
-        if (select(hSerial + 1, &set, NULL, NULL, NULL) > 0) {
-            if (FD_ISSET(hSerial, &set)) {
-                if ((cnt = read(hSerial, buf, sizeof(buf))) > 0) {
-                    int i;
-                    // check for breaks
-                    ssize_t realbytes = 0;
-                    for (i = 0; i < cnt; i++) {
-                      if (sawexit_valid)
-                        {
-                          exitcode = buf[i];
-                          //printf("exitcode: %02x\n", buf[i]);
-                          continue_terminal = 0;
-                        }
-                      else if (sawexit_char) {
-                        //printf("exitchar 2: %02x\n", buf[i]);
-                        if (buf[i] == 0) {
-                          sawexit_valid = 1;
-                        } else if (buf[i] == 1 && check_for_files) {
-                            int r = u9fs_process(cnt - (i+1), &buf[i+1]);
-                            i += (r-1);
-                            sawexit_char = 0;
-                            break;
-                        } else {
-                          realbuf[realbytes++] = exit_char;
-                          realbuf[realbytes++] = buf[i];
-                          sawexit_char = 0;
-                        }
-                      } else if (((int)buf[i] & 0xff) == exit_char) {
-                        //printf("exitchar: %02x\n", buf[i]);
-                        sawexit_char = 1;
-                      } else {
-                        realbuf[realbytes++] = buf[i];
-                        if (pst_mode && buf[i] == '\r')
-                            realbuf[realbytes++] = '\n';
-                      }
-                    }
-                    if (realbytes > 0) {
-                        write(fileno(stdout), realbuf, realbytes);
-                    }
-                }
-            }
-            if (FD_ISSET(STDIN_FILENO, &set)) {
-                if ((cnt = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
-                    int i;
-                    for (i = 0; i < cnt; ++i) {
-                        //printf("%02x\n", buf[i]);
-                        if (buf[i] == EXIT_CHAR0 || buf[i] == EXIT_CHAR1) {
-                            waitAtExit = 0; // user chose to quit
-                            goto done;
-                        }
-                    }
-                    write(hSerial, buf, cnt);
-                }
-            }
-        }
-    } while (continue_terminal);
+    if (reactor_watch(term->reactor, rfd, term_port, term) != 0
+        || reactor_watch(term->reactor, STDIN_FILENO, term_keys, term) != 0)
+    {
+        printf("Could not watch the port and keyboard: %s\n", strerror(errno));
+    } else {
+        reactor_run(term->reactor);
+    }
 
-done:
     if (isatty(STDIN_FILENO)) {
         tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
     }
 
+done:
+    u9fs_reply_with(NULL);
+    sawexit_valid = term->sawexit_valid;
+    exitcode = term->exitcode;
+    mux_free(&term->mux);
+    demux_free(&term->demux);
+    if (term->reactor) {
+        reactor_free(term->reactor);
+    }
+    free(term);
     if (sawexit_valid)
       {
         promptexit(exitcode);
@@ -506,7 +1554,7 @@ elapsedms(void)
 {
     struct timeval t;
 
-    if (!gettimeofday(&t, NULL)) {
+    if (gettimeofday(&t, NULL) != 0) {
         // how could this fail??
         return time(NULL) * 1000ULL;
     }
@@ -37,6 +37,8 @@
 static HANDLE hSerial = INVALID_HANDLE_VALUE;
 static COMMTIMEOUTS original_timeouts;
 static COMMTIMEOUTS timeouts;
+static unsigned long tx_byte_count = 0;
+static unsigned long tx_write_count = 0;
 
 static void ShowLastError(void);
 
@@ -147,6 +149,18 @@ int serial_baud(unsigned long baud)
     return 1;
 }
 
+/**
+ * fetch the baud rate the port is really running at
+ */
+unsigned long serial_actual_baud(void)
+{
+    DCB state;
+
+    if (!GetCommState(hSerial, &state))
+        return 0;
+    return state.BaudRate;
+}
+
 /**
  * flush (discard) all pending input
  */
@@ -184,14 +198,66 @@ void serial_done(void)
 int tx(uint8_t* buff, int n)
 {
     DWORD dwBytes = 0;
+    tx_write_count++;
     if(!WriteFile(hSerial, buff, n, &dwBytes, NULL)){
         printf("Error writing port\n");
         ShowLastError();
         return 0;
     }
+    tx_byte_count += dwBytes;
     return dwBytes;
 }
 
+/**
+ * write out any buffered transmit data
+ * tx() is not buffered here, so there is nothing to do
+ */
+int tx_flush(void)
+{
+    return 1;
+}
+
+/**
+ * fetch transmit statistics: bytes sent, and write calls used to do it
+ */
+void tx_stats(unsigned long *bytes, unsigned long *calls)
+{
+    *bytes = tx_byte_count;
+    *calls = tx_write_count;
+}
+
+/**
+ * there is no background i/o thread on Windows (yet); the port is only
+ * read when the program asks for input
+ */
+int serial_start_io(void)
+{
+    return 0;
+}
+
+void rx_stats(unsigned long *high_water, unsigned long *overruns)
+{
+    *high_water = 0;
+    *overruns = 0;
+}
+
+/**
+ * the terminal here does not understand channel frames
+ */
+int telemetry_open(const char *spec)
+{
+    printf("error: -TELEMETRY is not supported on this platform\n");
+    return 0;
+}
+
+/**
+ * there is no descriptor to wait on for port input here
+ */
+int serial_input_fd(void)
+{
+    return -1;
+}
+
 /**
  * receive a buffer
  * @param buff - char pointer to buffer
@@ -0,0 +1,234 @@
+/*
+ * portcache.c - remember which USB serial adapter has a P2 on it
+ *
+ * Finding a P2 means resetting every serial port in sight and asking
+ * each one for Prop_Chk. Instead, after a good run we note the USB
+ * identity of the adapter (vendor, product and serial number from sysfs)
+ * along with the silicon version, FIFO size and loader baud that worked,
+ * and the rate "-l auto" climbed to. The last is kept apart because the
+ * ROM is always loaded at the starting rate; only the loader goes faster.
+ * The next run can then go straight to that adapter, even if it has been
+ * given a different /dev name since, and only falls back to probing if
+ * the board does not answer there.
+ *
+ * The cache is a text file, most recently used adapter first:
+ *     vid:pid:serial port version fifo_size loader_baud auto_baud
+ * (files from before auto_baud was added have only the first five)
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "portcache.h"
+
+#if defined(__linux__)
+
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifndef SYSFS_ROOT
+#define SYSFS_ROOT "/sys"
+#endif
+
+#define MAX_CACHE_ENTRIES 32
+
+/*
+ * read the first line of a sysfs attribute, without the newline
+ */
+static int read_attr(const char *dir, const char *name, char *buf, int len)
+{
+    char path[PATH_MAX];
+    FILE *f;
+    char *p;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "r");
+    if (!f) return 0;
+    if (!fgets(buf, len, f)) {
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+    p = strchr(buf, '\n');
+    if (p) *p = 0;
+    return buf[0] != 0;
+}
+
+/*
+ * work out the identity of the USB adapter behind a tty
+ * we walk up from the tty's device directory to the USB device that
+ * owns it; adapters without a serial number are identified by the USB
+ * port they are plugged into instead
+ */
+static int port_id(const char *port, char *id, int len)
+{
+    char real[PATH_MAX];
+    char path[PATH_MAX];
+    char dev[PATH_MAX];
+    char vid[16], pid[16], serial[64];
+    const char *name;
+    char *p;
+
+    if (!realpath(port, real)) return 0;
+    name = strrchr(real, '/');
+    name = name ? name+1 : real;
+    if (snprintf(path, sizeof(path), "%s/class/tty/%s/device", SYSFS_ROOT, name) >= (int)sizeof(path))
+        return 0;
+    if (!realpath(path, dev)) return 0;
+
+    for (;;) {
+        if (read_attr(dev, "idVendor", vid, sizeof(vid))
+            && read_attr(dev, "idProduct", pid, sizeof(pid)))
+        {
+            if (!read_attr(dev, "serial", serial, sizeof(serial))) {
+                p = strrchr(dev, '/');
+                if (snprintf(serial, sizeof(serial), "@%s", p ? p+1 : dev) >= (int)sizeof(serial))
+                    return 0;
+            }
+            // the id is stored as one whitespace separated field
+            for (p = serial; *p; p++) {
+                if (*p == ' ' || *p == '\t') *p = '_';
+            }
+            snprintf(id, len, "%s:%s:%s", vid, pid, serial);
+            return 1;
+        }
+        p = strrchr(dev, '/');
+        if (!p || p == dev) return 0;
+        *p = 0;
+    }
+}
+
+static int cache_path(char *path, int len, int create)
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    char dir[PATH_MAX];
+
+    if (base && *base) {
+        snprintf(dir, sizeof(dir), "%s", base);
+    } else {
+        base = getenv("HOME");
+        if (!base || !*base) return 0;
+        snprintf(dir, sizeof(dir), "%s/.cache", base);
+        if (create) mkdir(dir, 0755);
+    }
+    strncat(dir, "/loadp2", sizeof(dir) - strlen(dir) - 1);
+    if (create) mkdir(dir, 0755);
+    snprintf(path, len, "%s/ports", dir);
+    return 1;
+}
+
+static int read_cache(PortCacheEntry *ent, int max)
+{
+    char path[PATH_MAX];
+    char line[512];
+    FILE *f;
+    int n = 0;
+
+    if (!cache_path(path, sizeof(path), 0)) return 0;
+    f = fopen(path, "r");
+    if (!f) return 0;
+    while (n < max && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        ent[n].auto_baud = 0;
+        if (sscanf(line, "%127s %255s %c %d %d %d", ent[n].id, ent[n].port,
+                   &ent[n].version, &ent[n].fifo_size, &ent[n].loader_baud,
+                   &ent[n].auto_baud) >= 5)
+        {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+int portcache_find(const char *portprefix, PortCacheEntry *ent)
+{
+    static PortCacheEntry cache[MAX_CACHE_ENTRIES];
+    char id[128];
+    char port[sizeof(ent->port)];
+    size_t prefixlen = strlen(portprefix);
+    struct dirent *entry;
+    DIR *dir;
+    int n, i;
+
+    n = read_cache(cache, MAX_CACHE_ENTRIES);
+    for (i = 0; i < n; i++) {
+        // usually the adapter is still where we left it
+        if (port_id(cache[i].port, id, sizeof(id)) && !strcmp(id, cache[i].id)) {
+            *ent = cache[i];
+            return 1;
+        }
+        // otherwise see if it has been renumbered
+        dir = opendir("/dev");
+        if (!dir) return 0;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strncmp(entry->d_name, portprefix, prefixlen) != 0) continue;
+            if (snprintf(port, sizeof(port), "/dev/%s", entry->d_name) >= (int)sizeof(port))
+                continue;
+            if (port_id(port, id, sizeof(id)) && !strcmp(id, cache[i].id)) {
+                *ent = cache[i];
+                strcpy(ent->port, port);
+                closedir(dir);
+                return 1;
+            }
+        }
+        closedir(dir);
+    }
+    return 0;
+}
+
+void portcache_update(const char *port, char version, int fifo_size, int loader_baud, int auto_baud)
+{
+    static PortCacheEntry cache[MAX_CACHE_ENTRIES];
+    char path[PATH_MAX];
+    char tmppath[PATH_MAX];
+    char id[128];
+    FILE *f;
+    int n, i, kept;
+
+    if (!port_id(port, id, sizeof(id))) return;
+    n = read_cache(cache, MAX_CACHE_ENTRIES);
+    // keep whatever baud rates last worked for loading
+    for (i = 0; i < n; i++) {
+        if (!strcmp(cache[i].id, id)) {
+            if (loader_baud <= 0) loader_baud = cache[i].loader_baud;
+            if (auto_baud <= 0) auto_baud = cache[i].auto_baud;
+            break;
+        }
+    }
+    if (!cache_path(path, sizeof(path), 1)) return;
+    if (snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int)getpid()) >= (int)sizeof(tmppath))
+        return;
+    f = fopen(tmppath, "w");
+    if (!f) return;
+    fprintf(f, "# loadp2 port cache: id port version fifo_size loader_baud auto_baud\n");
+    fprintf(f, "%s %s %c %d %d %d\n", id, port, version, fifo_size, loader_baud, auto_baud);
+    kept = 1;
+    for (i = 0; i < n && kept < MAX_CACHE_ENTRIES; i++) {
+        if (!strcmp(cache[i].id, id)) continue;
+        fprintf(f, "%s %s %c %d %d %d\n", cache[i].id, cache[i].port,
+                cache[i].version, cache[i].fifo_size, cache[i].loader_baud,
+                cache[i].auto_baud);
+        kept++;
+    }
+    if (fclose(f) != 0 || rename(tmppath, path) != 0) {
+        remove(tmppath);
+    }
+}
+
+#else
+
+/* adapter identities come from sysfs, so elsewhere there is nothing to cache */
+int portcache_find(const char *portprefix, PortCacheEntry *ent)
+{
+    return 0;
+}
+
+void portcache_update(const char *port, char version, int fifo_size, int loader_baud, int auto_baud)
+{
+}
+
+#endif
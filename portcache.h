@@ -0,0 +1,33 @@
+/*
+ * portcache.h - remember which USB serial adapter has a P2 on it
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __PORTCACHE_H__
+#define __PORTCACHE_H__
+
+/* what we know about a board from a previous run */
+typedef struct portcache_entry {
+    char id[128];       /* adapter identity: "vid:pid:serial" */
+    char port[256];     /* device the adapter is currently on */
+    char version;       /* silicon version from Prop_Ver */
+    int fifo_size;      /* FIFO size used for the last good load */
+    int loader_baud;    /* loader baud rate used for the last good load */
+    int auto_baud;      /* rate -l auto settled on; only for the loader */
+} PortCacheEntry;
+
+/*
+ * find the most recently used cached adapter that is still plugged in,
+ * following it to a new device name if it has moved
+ * returns 1 and fills in *ent if one is found, 0 if not
+ */
+int portcache_find(const char *portprefix, PortCacheEntry *ent);
+
+/*
+ * record a verified board on "port"; does nothing if the adapter
+ * has no identity we can look up
+ * a loader_baud or auto_baud of 0 keeps the rate recorded previously
+ */
+void portcache_update(const char *port, char version, int fifo_size, int loader_baud, int auto_baud);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * reactor.c - wait for several things at once
+ *
+ * The terminal has to watch the serial port and the keyboard, the file
+ * server and scripts need timeouts, and more channels may follow; each
+ * of them registers a handler here rather than building its own select()
+ * loop. On Linux this is epoll, with a timerfd for each timer; elsewhere
+ * it is poll(), with the timers kept in a table.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#define USE_EPOLL
+#endif
+#include "osint.h"
+#include "reactor.h"
+
+#define MAX_WATCHES 16
+
+typedef struct watch {
+    int fd;             /* -1 if the slot is free */
+    ReactorFunc fn;
+    void *arg;
+    int timer;          /* non-zero for a timer */
+    int always;         /* epoll can't watch it (a file), so it is always ready */
+    int period;
+    unsigned long long due;  /* when a timer next expires (without epoll) */
+} Watch;
+
+struct reactor {
+    Watch watches[MAX_WATCHES];
+    int stopped;
+    int next_timer;     /* numbers timers that have no descriptor */
+#ifdef USE_EPOLL
+    int epfd;
+#endif
+};
+
+Reactor *reactor_new(void)
+{
+    Reactor *r = calloc(1, sizeof(*r));
+    int i;
+
+    if (!r) {
+        return NULL;
+    }
+    for (i = 0; i < MAX_WATCHES; i++) {
+        r->watches[i].fd = -1;
+    }
+#ifdef USE_EPOLL
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epfd == -1) {
+        free(r);
+        return NULL;
+    }
+#endif
+    return r;
+}
+
+void reactor_free(Reactor *r)
+{
+    int i;
+
+    for (i = 0; i < MAX_WATCHES; i++) {
+        if (r->watches[i].fd != -1 && r->watches[i].timer) {
+            reactor_cancel(r, r->watches[i].fd);
+        }
+    }
+#ifdef USE_EPOLL
+    close(r->epfd);
+#endif
+    free(r);
+}
+
+static Watch *find_watch(Reactor *r, int fd, int timer)
+{
+    int i;
+
+    for (i = 0; i < MAX_WATCHES; i++) {
+        if (r->watches[i].fd == fd && (fd == -1 || r->watches[i].timer == timer)) {
+            return &r->watches[i];
+        }
+    }
+    return NULL;
+}
+
+static int add_watch(Reactor *r, int fd, ReactorFunc fn, void *arg, int timer)
+{
+    Watch *w = find_watch(r, -1, 0);
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+#endif
+
+    if (!w) {
+        return -1;
+    }
+#ifdef USE_EPOLL
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = w;
+    w->always = 0;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        if (errno != EPERM) {
+            return -1;
+        }
+        // a plain file, which would always be readable anyway
+        w->always = 1;
+    }
+#endif
+    w->fd = fd;
+    w->fn = fn;
+    w->arg = arg;
+    w->timer = timer;
+    return 0;
+}
+
+static void remove_watch(Reactor *r, Watch *w)
+{
+#ifdef USE_EPOLL
+    if (!w->always) {
+        epoll_ctl(r->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+    }
+#endif
+    w->fd = -1;
+}
+
+int reactor_watch(Reactor *r, int fd, ReactorFunc fn, void *arg)
+{
+    return add_watch(r, fd, fn, arg, 0);
+}
+
+void reactor_unwatch(Reactor *r, int fd)
+{
+    Watch *w = find_watch(r, fd, 0);
+
+    if (w) {
+        remove_watch(r, w);
+    }
+}
+
+int reactor_timer(Reactor *r, int ms, int period, ReactorFunc fn, void *arg)
+{
+    Watch *w;
+#ifdef USE_EPOLL
+    struct itimerspec its;
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (fd == -1) {
+        return -1;
+    }
+    memset(&its, 0, sizeof(its));
+    // a zero it_value would disarm the timer
+    if (ms <= 0) {
+        its.it_value.tv_nsec = 1;
+    } else {
+        its.it_value.tv_sec = ms / 1000;
+        its.it_value.tv_nsec = (ms % 1000) * 1000000L;
+    }
+    its.it_interval.tv_sec = period / 1000;
+    its.it_interval.tv_nsec = (period % 1000) * 1000000L;
+    if (timerfd_settime(fd, 0, &its, NULL) != 0 || add_watch(r, fd, fn, arg, 1) != 0) {
+        close(fd);
+        return -1;
+    }
+#else
+    // there is no descriptor to wait on, so number the timer -2, -3...
+    int fd = -2 - r->next_timer++;
+
+    if (add_watch(r, fd, fn, arg, 1) != 0) {
+        return -1;
+    }
+#endif
+    w = find_watch(r, fd, 1);
+    w->period = period;
+    w->due = elapsedms() + (ms > 0 ? ms : 0);
+    return fd;
+}
+
+void reactor_cancel(Reactor *r, int timer)
+{
+    Watch *w = find_watch(r, timer, 1);
+
+    if (w) {
+        remove_watch(r, w);
+#ifdef USE_EPOLL
+        close(timer);
+#endif
+    }
+}
+
+/* a timer has expired: re-arm it or forget it, then call its handler */
+static void fire_timer(Reactor *r, Watch *w)
+{
+    ReactorFunc fn = w->fn;
+    void *arg = w->arg;
+#ifdef USE_EPOLL
+    uint64_t expirations;
+
+    if (read(w->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+#endif
+    if (w->period) {
+        w->due += w->period;
+    } else {
+        reactor_cancel(r, w->fd);
+    }
+    fn(arg);
+}
+
+#ifdef USE_EPOLL
+int reactor_run(Reactor *r)
+{
+    struct epoll_event events[MAX_WATCHES];
+    Watch *w;
+    int i, n, always;
+
+    r->stopped = 0;
+    while (!r->stopped) {
+        always = 0;
+        for (i = 0; i < MAX_WATCHES && !r->stopped; i++) {
+            w = &r->watches[i];
+            if (w->fd != -1 && w->always) {
+                always = 1;
+                w->fn(w->arg);
+            }
+        }
+        n = epoll_wait(r->epfd, events, MAX_WATCHES, always ? 0 : -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (i = 0; i < n && !r->stopped; i++) {
+            w = (Watch *)events[i].data.ptr;
+            if (w->fd == -1) {
+                // removed by an earlier handler
+                continue;
+            }
+            if (w->timer) {
+                fire_timer(r, w);
+            } else {
+                w->fn(w->arg);
+            }
+        }
+    }
+    return 0;
+}
+#else
+int reactor_run(Reactor *r)
+{
+    struct pollfd pfd[MAX_WATCHES];
+    Watch *which[MAX_WATCHES];
+    unsigned long long now, first;
+    int i, n, timeout;
+
+    r->stopped = 0;
+    while (!r->stopped) {
+        now = elapsedms();
+        first = 0;
+        n = 0;
+        for (i = 0; i < MAX_WATCHES; i++) {
+            Watch *w = &r->watches[i];
+            if (w->fd == -1) continue;
+            if (w->timer) {
+                if (!first || w->due < first) first = w->due;
+            } else {
+                pfd[n].fd = w->fd;
+                pfd[n].events = POLLIN;
+                pfd[n].revents = 0;
+                which[n++] = w;
+            }
+        }
+        timeout = !first ? -1 : first <= now ? 0 : (int)(first - now);
+        if (poll(pfd, n, timeout) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (i = 0; i < n && !r->stopped; i++) {
+            if (which[i]->fd != -1 && pfd[i].revents) {
+                which[i]->fn(which[i]->arg);
+            }
+        }
+        now = elapsedms();
+        for (i = 0; i < MAX_WATCHES && !r->stopped; i++) {
+            Watch *w = &r->watches[i];
+            if (w->fd != -1 && w->timer && w->due <= now) {
+                fire_timer(r, w);
+            }
+        }
+    }
+    return 0;
+}
+#endif
+
+void reactor_stop(Reactor *r)
+{
+    r->stopped = 1;
+}
@@ -0,0 +1,39 @@
+/*
+ * reactor.h - wait for several things at once
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+typedef struct reactor Reactor;
+
+/* called when a watched descriptor is readable, or a timer expires */
+typedef void (*ReactorFunc)(void *arg);
+
+Reactor *reactor_new(void);
+void reactor_free(Reactor *r);
+
+/*
+ * call fn(arg) whenever fd is readable
+ * returns 0 on success, -1 on failure
+ */
+int reactor_watch(Reactor *r, int fd, ReactorFunc fn, void *arg);
+void reactor_unwatch(Reactor *r, int fd);
+
+/*
+ * call fn(arg) after ms milliseconds, and every period milliseconds
+ * after that if period is non-zero
+ * returns a timer number for reactor_cancel(), or -1 on failure
+ */
+int reactor_timer(Reactor *r, int ms, int period, ReactorFunc fn, void *arg);
+void reactor_cancel(Reactor *r, int timer);
+
+/*
+ * handle events until a handler calls reactor_stop()
+ * returns 0, or -1 if waiting failed
+ */
+int reactor_run(Reactor *r);
+void reactor_stop(Reactor *r);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * ring.c - lock-free byte rings between two threads
+ *
+ * The serial i/o thread keeps the port drained into one of these while
+ * the main thread is busy (serving a file, say), and sends what the
+ * main thread puts in another. With one producer and one consumer the
+ * two indices are all the synchronization needed.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+int ring_init(Ring *r, unsigned size)
+{
+    r->buf = malloc(size);
+    r->size = size;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->high_water, 0);
+    atomic_init(&r->overruns, 0);
+    return r->buf != NULL;
+}
+
+void ring_free(Ring *r)
+{
+    free(r->buf);
+    r->buf = NULL;
+}
+
+unsigned ring_used(Ring *r)
+{
+    return atomic_load_explicit(&r->head, memory_order_acquire)
+        - atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+int ring_write(Ring *r, const uint8_t *data, int n)
+{
+    unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    unsigned space = r->size - (head - tail);
+    unsigned at = head & (r->size - 1);
+    unsigned first;
+
+    if ((unsigned)n > space) n = space;
+    first = r->size - at;
+    if (first > (unsigned)n) first = n;
+    memcpy(r->buf + at, data, first);
+    memcpy(r->buf, data + first, n - first);
+    // noted before the data is published, so a consumer that has seen
+    // the data sees the count too
+    if (head + n - tail > atomic_load_explicit(&r->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&r->high_water, head + n - tail, memory_order_relaxed);
+    }
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+    return n;
+}
+
+int ring_read(Ring *r, uint8_t *data, int n)
+{
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+    unsigned at = tail & (r->size - 1);
+    unsigned first;
+
+    if ((unsigned)n > head - tail) n = head - tail;
+    first = r->size - at;
+    if (first > (unsigned)n) first = n;
+    memcpy(data, r->buf + at, first);
+    memcpy(data + first, r->buf, n - first);
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+    return n;
+}
+
+const uint8_t *ring_peek(Ring *r, int *n)
+{
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+    unsigned at = tail & (r->size - 1);
+    unsigned avail = head - tail;
+
+    *n = avail < r->size - at ? avail : r->size - at;
+    return r->buf + at;
+}
+
+void ring_skip(Ring *r, int n)
+{
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+}
@@ -0,0 +1,47 @@
+/*
+ * ring.h - lock-free byte rings between two threads
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * a ring has exactly one producer thread, which calls ring_write(), and
+ * one consumer thread, which calls the rest; neither ever waits for
+ * the other
+ */
+typedef struct ring {
+    uint8_t *buf;
+    unsigned size;              /* a power of two */
+    atomic_uint head;           /* bytes ever written; only the producer changes it */
+    atomic_uint tail;           /* bytes ever read; only the consumer changes it */
+    atomic_ulong high_water;    /* most bytes it has held; kept by the producer */
+    atomic_ulong overruns;      /* bytes the producer had to drop; kept by it */
+} Ring;
+
+/* set up an empty ring holding size bytes (a power of two); returns 0 on failure */
+int ring_init(Ring *r, unsigned size);
+void ring_free(Ring *r);
+
+/* bytes waiting to be read */
+unsigned ring_used(Ring *r);
+
+/* store up to n bytes; returns how many fitted */
+int ring_write(Ring *r, const uint8_t *data, int n);
+
+/* fetch up to n bytes; returns how many there were */
+int ring_read(Ring *r, uint8_t *data, int n);
+
+/*
+ * look at the waiting bytes without copying them: returns a pointer
+ * to as many as are contiguous, and sets *n to the count; ring_skip()
+ * then consumes them
+ */
+const uint8_t *ring_peek(Ring *r, int *n);
+void ring_skip(Ring *r, int n);
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * rle.c - run length encoding for compressed loads
+ *
+ * Program images are mostly code, which does not compress much, but
+ * they often carry long stretches of zeros (tables, buffers, padding
+ * up to a fixed address), and those are what cost the most time on
+ * the wire. A simple byte oriented run length code catches those, and
+ * is cheap enough to decode at full serial speed in MainLoader_chip.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include "rle.h"
+
+static int flush_literals(uint8_t *out, const uint8_t *lit, int n)
+{
+    int used = 0;
+    int chunk, i;
+
+    while (n > 0) {
+        chunk = n > RLE_MAXLIT ? RLE_MAXLIT : n;
+        *out++ = chunk - 1;
+        for (i = 0; i < chunk; i++) {
+            *out++ = *lit++;
+        }
+        used += chunk + 1;
+        n -= chunk;
+    }
+    return used;
+}
+
+int rle_encode(uint8_t *out, const uint8_t *in, int len, int maxrun)
+{
+    int outlen = 0;
+    int litstart = 0;
+    int i = 0;
+    int run;
+
+    if (maxrun > RLE_MAXRUN) maxrun = RLE_MAXRUN;
+    while (i < len) {
+        run = 1;
+        while (run < maxrun && i + run < len && in[i + run] == in[i]) {
+            run++;
+        }
+        if (maxrun >= RLE_MINRUN && run >= RLE_MINRUN) {
+            outlen += flush_literals(out + outlen, in + litstart, i - litstart);
+            out[outlen++] = 0x80 + run - RLE_MINRUN;
+            out[outlen++] = in[i];
+            i += run;
+            litstart = i;
+        } else {
+            i++;
+        }
+    }
+    outlen += flush_literals(out + outlen, in + litstart, i - litstart);
+    return outlen;
+}
+
+int rle_decode(uint8_t *out, int outlen, const uint8_t *in, int inlen)
+{
+    int i = 0;
+    int n, c;
+
+    while (outlen > 0) {
+        if (i >= inlen) return -1;
+        c = in[i++];
+        if (c < 0x80) {
+            n = c + 1;
+            if (n > outlen || i + n > inlen) return -1;
+            while (n-- > 0) {
+                *out++ = in[i++];
+            }
+            outlen -= c + 1;
+        } else {
+            n = c - 0x80 + RLE_MINRUN;
+            if (n > outlen || i >= inlen) return -1;
+            outlen -= n;
+            while (n-- > 0) {
+                *out++ = in[i];
+            }
+            i++;
+        }
+    }
+    return i;
+}
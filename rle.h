@@ -0,0 +1,38 @@
+/*
+ * rle.h - run length encoding for compressed loads
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __RLE_H__
+#define __RLE_H__
+
+#include <stdint.h>
+
+/*
+ * The encoded stream is a sequence of control bytes:
+ *   c < 0x80:  c+1 literal bytes follow
+ *   c >= 0x80: one byte follows, which is repeated (c - 0x80 + RLE_MINRUN) times
+ * This matches the REC_RLE decoder in MainLoader_chip.spin2.
+ */
+#define RLE_MINRUN  3
+#define RLE_MAXRUN  (0x7f + RLE_MINRUN)
+#define RLE_MAXLIT  0x80
+
+/* worst case size of the encoding of len bytes */
+#define RLE_MAX_ENCODED(len) ((len) + ((len) + RLE_MAXLIT - 1) / RLE_MAXLIT)
+
+/*
+ * encode len bytes from in to out, using no run longer than maxrun
+ * (maxrun below RLE_MINRUN gives all literals)
+ * returns the number of bytes written to out
+ */
+int rle_encode(uint8_t *out, const uint8_t *in, int len, int maxrun);
+
+/*
+ * decode in to exactly outlen bytes at out
+ * returns the number of encoded bytes used, or -1 if the encoding is
+ * malformed or does not produce exactly outlen bytes
+ */
+int rle_decode(uint8_t *out, int outlen, const uint8_t *in, int inlen);
+
+#endif
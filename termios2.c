@@ -0,0 +1,47 @@
+/*
+ * termios2.c - set an arbitrary baud rate on Linux
+ *
+ * The termios2 interface lets us ask the driver for any baud rate
+ * (BOTHER), e.g. the 3, 4, 6 and 8 Mbaud that FT232H and FT2232
+ * adapters can do. The layout of struct termios2 differs from one
+ * architecture to another, and the ioctl numbers depend on its size,
+ * so it has to come from the kernel's <asm/termbits.h>. That clashes
+ * with glibc's <termios.h>, hence a file of its own.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#if defined(__linux__)
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#endif
+#include "termios2.h"
+
+int set_custom_baud(int fd, unsigned long baud, unsigned long *actual)
+{
+#if defined(__linux__) && defined(TCGETS2) && defined(BOTHER)
+    struct termios2 tio;
+
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        return 0;
+    }
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+#ifdef IBSHIFT
+    tio.c_cflag &= ~(CBAUD << IBSHIFT);
+    tio.c_cflag |= BOTHER << IBSHIFT;
+#endif
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+    if (ioctl(fd, TCSETS2, &tio) != 0) {
+        return 0;
+    }
+    // read back what the driver really did
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        return 0;
+    }
+    *actual = tio.c_ospeed;
+    return 1;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,16 @@
+/*
+ * termios2.h - set an arbitrary baud rate on Linux
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __TERMIOS2_H__
+#define __TERMIOS2_H__
+
+/*
+ * set the port to exactly "baud" using BOTHER, and record the rate
+ * the driver says it actually achieved in *actual
+ * returns 1 on success, 0 if the driver refuses or this system can't
+ */
+int set_custom_baud(int fd, unsigned long baud, unsigned long *actual);
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * fuzzdemux.c - randomised test of demux.c and mux.c
+ *
+ * Builds streams of what a P2 might print: console text, stray escapes,
+ * 9P messages, channel frames (with 9P messages split across several
+ * of them) and finally an exit code. Each stream is fed to demux_input()
+ * in pieces of random size, with channel data going on to mux_input(),
+ * and everything that comes out is checked against what went in.
+ *
+ * usage: fuzzdemux [iterations [seed]]
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "demux.h"
+#include "mux.h"
+
+#define MAXMSG    8216
+#define MAXSTREAM (1 << 18)
+
+/* a growing record of what came out, or what should have */
+typedef struct output {
+    uint8_t data[MAXSTREAM];
+    int len;
+    int count;      /* messages, where that matters */
+} Output;
+
+static Output got_text, got_frames, got_chan[MUX_CHANNELS];
+static Output want_text, want_frames, want_chan[MUX_CHANNELS];
+static int got_exit;
+static Mux mux;
+
+static void add(Output *o, const uint8_t *data, int len)
+{
+    if (o->len + len > MAXSTREAM) {
+        printf("FAIL: output overflow\n");
+        exit(1);
+    }
+    memcpy(o->data + o->len, data, len);
+    o->len += len;
+    o->count++;
+}
+
+static void put_byte(Output *o, int c)
+{
+    uint8_t b = c;
+
+    add(o, &b, 1);
+}
+
+static void on_text(void *arg, const uint8_t *data, int len)
+{
+    add(&got_text, data, len);
+}
+
+static void on_exitcode(void *arg, int code)
+{
+    got_exit = code;
+}
+
+static void on_frame(void *arg, const uint8_t *msg, int len)
+{
+    add(&got_frames, msg, len);
+}
+
+static void on_chunk(void *arg, int chan, const uint8_t *data, int len)
+{
+    mux_input(&mux, chan, data, len);
+}
+
+static void on_send(void *arg, const uint8_t *data, int len)
+{
+}
+
+static void on_deliver(void *arg, int chan, const uint8_t *data, int len)
+{
+    add(&got_chan[chan], data, len);
+}
+
+static void on_started(void *arg)
+{
+}
+
+static const DemuxOps demux_ops = { on_text, on_exitcode, on_frame, on_chunk };
+static const MuxOps mux_ops = { on_send, on_deliver, on_started };
+
+/* a 9P-sized message with random contents */
+static int make_message(uint8_t *msg)
+{
+    int len = DEMUX_MINFRAME + rand() % 600;
+    int i;
+
+    msg[0] = len;
+    msg[1] = len >> 8;
+    msg[2] = 0;
+    msg[3] = 0;
+    for (i = 4; i < len; i++) {
+        msg[i] = rand();
+    }
+    return len;
+}
+
+static void channel_frame(Output *in, int chan, const uint8_t *data, int len)
+{
+    put_byte(in, DEMUX_ESC);
+    put_byte(in, MUX_FRAME);
+    put_byte(in, chan);
+    put_byte(in, len);
+    put_byte(in, len >> 8);
+    add(in, data, len);
+}
+
+/* build one stream, noting what should come out of it */
+static void make_stream(Output *in, int code)
+{
+    uint8_t msg[MAXMSG];
+    uint8_t data[MUX_MAXDATA];
+    int parts = rand() % 30;
+    int i, j, len, n, chan, c;
+
+    while (parts-- > 0) {
+        switch (rand() % 6) {
+        case 0:
+            // plain text, without escapes
+            len = rand() % 50;
+            for (i = 0; i < len; i++) {
+                c = rand() % DEMUX_ESC;
+                put_byte(in, c);
+                put_byte(&want_text, c);
+            }
+            break;
+        case 1:
+            // an escape that isn't one
+            c = 3 + rand() % (DEMUX_ESC - 3);
+            put_byte(in, DEMUX_ESC);
+            put_byte(in, c);
+            put_byte(&want_text, DEMUX_ESC);
+            put_byte(&want_text, c);
+            break;
+        case 2:
+            // a 9P message outside the channels
+            len = make_message(msg);
+            put_byte(in, DEMUX_ESC);
+            put_byte(in, 1);
+            add(in, msg, len);
+            add(&want_frames, msg, len);
+            break;
+        case 3:
+            // console or telemetry data
+            chan = rand() % 2 ? MUX_CONSOLE : MUX_TELEMETRY;
+            len = 1 + rand() % MUX_MAXDATA;
+            for (i = 0; i < len; i++) {
+                data[i] = rand();
+            }
+            channel_frame(in, chan, data, len);
+            add(&want_chan[chan], data, len);
+            break;
+        case 4:
+            // 9P messages on their channel, split anywhere
+            len = 0;
+            n = 1 + rand() % 3;
+            for (i = 0; i < n; i++) {
+                j = make_message(msg + len);
+                add(&want_chan[MUX_9P], msg + len, j);
+                len += j;
+            }
+            for (i = 0; i < len; i += j) {
+                j = 1 + rand() % (rand() % 2 ? 8 : MUX_MAXDATA);
+                if (j > len - i) j = len - i;
+                channel_frame(in, MUX_9P, msg + i, j);
+            }
+            break;
+        default:
+            // a channel frame that isn't one: bad channel number
+            put_byte(in, DEMUX_ESC);
+            put_byte(in, MUX_FRAME);
+            put_byte(in, MUX_CHANNELS + rand() % 10);
+            put_byte(in, 1);
+            put_byte(in, 0);
+            put_byte(&want_text, DEMUX_ESC);
+            put_byte(&want_text, MUX_FRAME);
+            add(&want_text, in->data + in->len - 3, 3);
+            break;
+        }
+    }
+    put_byte(in, DEMUX_ESC);
+    put_byte(in, 0);
+    put_byte(in, code);
+}
+
+static int same(const char *what, Output *got, Output *want)
+{
+    if (got->len == want->len && !memcmp(got->data, want->data, got->len)) {
+        return 1;
+    }
+    printf("FAIL: %s: got %d bytes, expected %d\n", what, got->len, want->len);
+    return 0;
+}
+
+static Output input;
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    unsigned seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+    Demux demux;
+    int iter, n, pos, used, code, total, ok;
+
+    srand(seed);
+    for (iter = 0; iter < iterations; iter++) {
+        memset(&input, 0, sizeof(input));
+        memset(&got_text, 0, sizeof(got_text));
+        memset(&want_text, 0, sizeof(want_text));
+        memset(&got_frames, 0, sizeof(got_frames));
+        memset(&want_frames, 0, sizeof(want_frames));
+        memset(got_chan, 0, sizeof(got_chan));
+        memset(want_chan, 0, sizeof(want_chan));
+        got_exit = -1;
+
+        code = rand() & 0xff;
+        make_stream(&input, code);
+        total = input.len;
+        // whatever follows the exit code must be left alone
+        add(&input, (const uint8_t *)"after", 5);
+
+        if (demux_init(&demux, DEMUX_EXIT | DEMUX_FILES | DEMUX_CHANNELS, MAXMSG, &demux_ops, NULL)
+            || mux_init(&mux, MAXMSG, &mux_ops, NULL))
+        {
+            printf("FAIL: out of memory\n");
+            return 1;
+        }
+        used = 0;
+        for (pos = 0; pos < input.len; pos += n) {
+            n = 1 + rand() % (rand() % 2 ? 3 : 400);
+            if (n > input.len - pos) n = input.len - pos;
+            used += demux_input(&demux, input.data + pos, n);
+        }
+        demux_free(&demux);
+        mux_free(&mux);
+
+        ok = same("text", &got_text, &want_text);
+        ok &= same("9P messages", &got_frames, &want_frames);
+        if (got_frames.count != want_frames.count) {
+            printf("FAIL: got %d 9P messages, expected %d\n", got_frames.count, want_frames.count);
+            ok = 0;
+        }
+        ok &= same("console", &got_chan[MUX_CONSOLE], &want_chan[MUX_CONSOLE]);
+        ok &= same("telemetry", &got_chan[MUX_TELEMETRY], &want_chan[MUX_TELEMETRY]);
+        ok &= same("9P channel", &got_chan[MUX_9P], &want_chan[MUX_9P]);
+        if (got_chan[MUX_9P].count != want_chan[MUX_9P].count) {
+            printf("FAIL: got %d messages on the 9P channel, expected %d\n",
+                   got_chan[MUX_9P].count, want_chan[MUX_9P].count);
+            ok = 0;
+        }
+        if (got_exit != code) {
+            printf("FAIL: exit code %d, expected %d\n", got_exit, code);
+            ok = 0;
+        }
+        if (used != total) {
+            printf("FAIL: used %d bytes, expected %d\n", used, total);
+            ok = 0;
+        }
+        if (!ok) {
+            printf("iteration %d of seed %u\n", iter, seed);
+            return 1;
+        }
+    }
+    printf("fuzzdemux: %d streams ok\n", iterations);
+    return 0;
+}
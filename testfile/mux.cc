@@ -0,0 +1,239 @@
+//
+// several channels to loadp2 over the one serial port
+//
+// every frame is $FF $02 channel len_lo len_hi, then len bytes of data;
+// neither side sends more on a channel than the other has given it
+// credit for, so (for example) a slow telemetry sink does not hold up
+// the console
+//
+
+#include <string.h>
+#include <stdint.h>
+#include "mux.h"
+
+// messages on MUX_CONTROL
+#define MUX_HELLO   1   // MUX_HELLO version
+#define MUX_CREDIT  2   // MUX_CREDIT chan n_lo n_hi
+#define MUX_VERSION 1
+
+// keys typed at the host, waiting for mux_getc()
+#define KEYBUF 64
+
+static mux_tx_func txfn;
+static mux_rx_func rxfn;
+
+// bytes the host will still take on each channel
+static int credit[4];
+
+static uint8_t keys[KEYBUF];
+static int keyhead, keycount;
+static int keysread;    // taken since the host was last told
+
+// where the reply to a 9P request goes
+static uint8_t *replybuf;
+static int replymax;
+static int replylen;
+static int replyroom;   // 9P credit the host still has
+
+// the frame coming in
+static int instate;
+static int inchan;
+static int inleft;
+static uint8_t ctl[4];
+static int nctl;
+
+static void send_frame(int chan, const uint8_t *buf, int len)
+{
+    txfn(0xff);
+    txfn(0x02);
+    txfn(chan);
+    txfn(len & 0xff);
+    txfn((len >> 8) & 0xff);
+    while (len-- > 0) {
+        txfn(*buf++);
+    }
+}
+
+static void send_credit(int chan, int n)
+{
+    uint8_t msg[4];
+
+    msg[0] = MUX_CREDIT;
+    msg[1] = chan;
+    msg[2] = n & 0xff;
+    msg[3] = (n >> 8) & 0xff;
+    send_frame(MUX_CONTROL, msg, 4);
+}
+
+static void control(int c)
+{
+    int chan;
+
+    ctl[nctl++] = c;
+    if (ctl[0] == MUX_CREDIT) {
+        if (nctl < 4) return;
+        chan = ctl[1];
+        if (chan > MUX_CONTROL && chan <= MUX_TELEMETRY) {
+            credit[chan] += ctl[2] | (ctl[3] << 8);
+        }
+    }
+    nctl = 0;
+}
+
+// one byte of a frame's data
+static void got_byte(int chan, int c)
+{
+    switch (chan) {
+    case MUX_CONTROL:
+        control(c);
+        break;
+    case MUX_CONSOLE:
+        // the host never sends more than there is room for
+        if (keycount < KEYBUF) {
+            keys[(keyhead + keycount) % KEYBUF] = c;
+            keycount++;
+        }
+        break;
+    case MUX_9P:
+        if (replylen < replymax) {
+            replybuf[replylen] = c;
+        }
+        replylen++;
+        replyroom--;
+        break;
+    default:
+        break;
+    }
+}
+
+static void rx_byte(int c)
+{
+    switch (instate) {
+    case 0:
+        // anything between frames is noise
+        if (c == 0xff) instate = 1;
+        break;
+    case 1:
+        instate = (c == 0x02) ? 2 : 0;
+        break;
+    case 2:
+        inchan = c;
+        instate = 3;
+        break;
+    case 3:
+        inleft = c;
+        instate = 4;
+        break;
+    case 4:
+        inleft |= (c << 8);
+        instate = inleft ? 5 : 0;
+        break;
+    default:
+        got_byte(inchan, c);
+        if (--inleft == 0) {
+            instate = 0;
+        }
+        break;
+    }
+}
+
+int mux_init(mux_tx_func tx, mux_rx_func rx)
+{
+    uint8_t hello[2];
+
+    txfn = tx;
+    rxfn = rx;
+    instate = nctl = 0;
+    keyhead = keycount = keysread = 0;
+    replyroom = 0;
+    memset(credit, 0, sizeof(credit));
+
+    hello[0] = MUX_HELLO;
+    hello[1] = MUX_VERSION;
+    send_frame(MUX_CONTROL, hello, 2);
+    send_credit(MUX_CONSOLE, KEYBUF);
+    return 0;
+}
+
+void mux_poll(void)
+{
+    int c;
+
+    while ((c = (*rxfn)()) >= 0) {
+        rx_byte(c);
+    }
+}
+
+int mux_write(int chan, const uint8_t *buf, int count)
+{
+    int sent = 0;
+    int n;
+
+    while (sent < count) {
+        while (credit[chan] == 0) {
+            mux_poll();
+        }
+        n = count - sent;
+        if (n > credit[chan]) n = credit[chan];
+        if (n > MUX_MAXDATA) n = MUX_MAXDATA;
+        send_frame(chan, buf + sent, n);
+        credit[chan] -= n;
+        sent += n;
+    }
+    return sent;
+}
+
+int mux_getc(void)
+{
+    int c;
+
+    mux_poll();
+    if (keycount == 0) {
+        return -1;
+    }
+    c = keys[keyhead];
+    keyhead = (keyhead + 1) % KEYBUF;
+    keycount--;
+    if (++keysread >= KEYBUF/2) {
+        send_credit(MUX_CONSOLE, keysread);
+        keysread = 0;
+    }
+    return c;
+}
+
+// send a buffer to the host
+// then receive a reply
+// returns the length of the reply, which is also the first
+// longword in the buffer
+int mux_sendrecv(uint8_t *startbuf, uint8_t *endbuf, int maxlen)
+{
+    int len = endbuf - startbuf;
+    unsigned size;
+
+    if (len <= 4) {
+        return -1; // not a valid message
+    }
+    startbuf[0] = len & 0xff;
+    startbuf[1] = (len>>8) & 0xff;
+    startbuf[2] = (len>>16) & 0xff;
+    startbuf[3] = (len>>24) & 0xff;
+
+    replybuf = startbuf;
+    replymax = maxlen;
+    replylen = 0;
+    // make sure the host can send a whole reply
+    if (replyroom < maxlen) {
+        send_credit(MUX_9P, maxlen - replyroom);
+        replyroom = maxlen;
+    }
+    mux_write(MUX_9P, startbuf, len);
+    for(;;) {
+        mux_poll();
+        if (replylen >= 4) {
+            size = startbuf[0] | (startbuf[1]<<8) | (startbuf[2]<<16) | (startbuf[3]<<24);
+            if (replylen >= size) {
+                return size;
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MUX_H
+#define MUX_H
+
+#include <compiler.h>
+
+// channels to loadp2 over the one serial port
+// these must match loadp2's mux.h
+enum {
+    MUX_CONTROL = 0,
+    MUX_CONSOLE,    // text for the terminal, and keys typed there
+    MUX_9P,         // requests for loadp2's file server, and replies
+    MUX_TELEMETRY,  // saved by loadp2 -TELEMETRY
+};
+
+// most data in one frame
+#define MUX_MAXDATA 1024
+
+// send one byte to the host
+typedef void (*mux_tx_func)(int c);
+// fetch one byte from the host, or -1 if none is waiting
+typedef int (*mux_rx_func)(void);
+
+// tell loadp2 to use channels from now on
+// after this everything it sends is framed, so all input from
+// the host must go through mux_poll()
+int mux_init(mux_tx_func tx, mux_rx_func rx) _IMPL("mux.cc");
+
+// send count bytes on a channel, waiting (and handling input) while
+// loadp2 has no room for them
+int mux_write(int chan, const uint8_t *buf, int count);
+
+// handle whatever the host has sent
+// mux_write(), mux_getc() and mux_sendrecv() all do this too
+void mux_poll(void);
+
+// fetch a key typed at the terminal, or -1 if there is none
+int mux_getc(void);
+
+// send a 9P request and wait for the reply; pass this to fs_init()
+int mux_sendrecv(uint8_t *startbuf, uint8_t *endbuf, int maxlen);
+
+#endif
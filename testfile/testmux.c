@@ -0,0 +1,82 @@
+//
+// simple test program for channels to loadp2
+// shows the "fs9p.h" file from this directory on the console while
+// sending a count to the telemetry channel, then echoes keys until
+// a '.' is typed
+// run with: loadp2 -9 . -TELEMETRY count.bin testmux.binary
+//
+// note: this program has not yet been run on a P2. mux.cc has only
+// been tried compiled for the host, talking to loadp2 over a pty
+//
+
+#include <string.h>
+#include <stdint.h>
+#include "fs9p.h"
+#include "mux.h"
+
+struct __using("spin/SmartSerial") ser;
+
+void serTx(int c)
+{
+    ser.tx(c);
+}
+
+// mux_poll() needs -1 when nothing has arrived, rather than waiting
+int serRx()
+{
+    return ser.rxcheck();
+}
+
+void say(const char *s)
+{
+    mux_write(MUX_CONSOLE, (const uint8_t *)s, strlen(s));
+}
+
+fs_file testfile;
+
+// test program
+int main()
+{
+    int r;
+    int c;
+    unsigned count = 0;
+    char buf[80];
+    char out[160];
+    _clkset(0x010007f8, 160000000);
+    ser.start(63, 62, 0, 230400);
+    mux_init(serTx, serRx);
+    say("mux test program...\r\n");
+    r = fs_init(mux_sendrecv);
+    if (r == 0) {
+        r = fs_open(&testfile, (char *)"fs9p.h", 0);
+    }
+    if (r == 0) {
+        int i;
+        int n;
+        do {
+            r = fs_read(&testfile, buf, sizeof(buf));
+            for (i = n = 0; i < r; i++) {
+                if (buf[i] == 10)
+                    out[n++] = 13;
+                if (buf[i] != 13)
+                    out[n++] = buf[i];
+            }
+            mux_write(MUX_CONSOLE, (uint8_t *)out, n);
+            count++;
+            mux_write(MUX_TELEMETRY, (uint8_t *)&count, 4);
+        } while (r > 0);
+        fs_close(&testfile);
+        say("EOF\r\n");
+    } else {
+        say("could not read fs9p.h\r\n");
+    }
+    say("type something; . to finish\r\n");
+    do {
+        c = mux_getc();
+        if (c >= 0) {
+            buf[0] = c;
+            mux_write(MUX_CONSOLE, (uint8_t *)buf, 1);
+        }
+    } while (c != '.');
+    return 0;
+}
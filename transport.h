@@ -0,0 +1,68 @@
+/*
+ * transport.h - connections to boards
+ *
+ * The serial i/o routines in osint.h all work on the current
+ * connection, a Transport. Each kind of connection (a serial port, a
+ * TCP socket to a serial bridge, an in-process loopback) supplies a
+ * table of TransportOps, serial_init() picks one from the port name,
+ * and any number of Transports may be open at once.
+ *
+ * MIT License; see the LICENSE file for details
+ */
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#include <stdint.h>
+
+/* size of the transmit buffer; see tx() */
+#define TX_BUFSIZE 8192
+
+typedef struct transport Transport;
+
+typedef struct transport_ops {
+    /* port names starting with this use these ops */
+    const char *prefix;
+    /* open the port (name has the prefix removed); returns 1 on success */
+    int (*open)(Transport *t, const char *name, unsigned long baud);
+    /* change the baud rate; returns 1 on success, or 0 leaving it alone */
+    int (*set_baud)(Transport *t, unsigned long baud);
+    /* read up to n bytes once fd is readable; returns <= 0 on error */
+    int (*read)(Transport *t, uint8_t *buf, int n);
+    /* write up to n bytes; returns the count, or -1 with errno set */
+    int (*write)(Transport *t, const uint8_t *buf, int n);
+    /* set or clear the reset line; NULL if there isn't one */
+    void (*reset_line)(Transport *t, int on);
+    /* throw away any input not yet read */
+    int (*flush_input)(Transport *t);
+    /* wait for written data to leave the host */
+    int (*drain)(Transport *t);
+    void (*close)(Transport *t);
+} TransportOps;
+
+struct transport {
+    const TransportOps *ops;
+    int fd;                     /* becomes readable when input arrives */
+    int wfd;                    /* output goes here; usually fd */
+    char name[256];             /* the port name, prefix and all */
+    unsigned long baud;
+    unsigned long actual_baud;  /* what the port really runs at */
+    uint8_t txbuf[TX_BUFSIZE];
+    int txbuf_len;
+    struct transport_io *io;    /* the background i/o thread, if running */
+};
+
+/*
+ * open a port: "tcp:host:port" is a raw TCP connection to a serial
+ * bridge such as ser2net, "loop:" gives back whatever is sent to it,
+ * and anything else is a serial port
+ * returns NULL on failure
+ */
+Transport *transport_open(const char *port, unsigned long baud);
+
+/* send anything still buffered, and close the port */
+void transport_close(Transport *t);
+
+/* make t the port the osint.h routines use; returns the previous one */
+Transport *serial_select(Transport *t);
+
+#endif
@@ -30,8 +30,24 @@ readn(int f, void *av, long n)
 	return t;
 }
 
+// where replies go, if not straight to the port
+static long (*reply_fn)(void *av, long n);
+
+void
+u9fs_reply_with(long (*fn)(void *av, long n))
+{
+    reply_fn = fn;
+}
+
 long
 writen(int f, void *av, long n)
 {
-    return tx((uint8_t *)av, (int)n);
+    long r;
+
+    if (reply_fn)
+        return reply_fn(av, n);
+    r = tx((uint8_t *)av, (int)n);
+    // the P2 is waiting for this, so don't leave it in the tx buffer
+    tx_flush();
+    return r;
 }
@@ -322,6 +322,13 @@ isowner(User *u, Fid *f)
 
 
 
+// the longest message u9fs_process() can be handed
+int
+u9fs_maxmsg(void)
+{
+	return msize;
+}
+
 // handle one u9fs transaction
 // "nbuf" is number of characters already read from the serial,
 // which we will have to fetch before readn